@@ -171,14 +171,16 @@ ignore_int:
 * will be mapped to some other place - mm keeps track of
 * that.
 *
-* For those with more memory than 16 Mb - tough luck. I've
-* not got it, why should you :-) The source is here. Change
-* it. (Seriously - it shouldn't be too difficult. Mostly
-* change some constants etc. I left it at 16Mb, as my machine
-* even cannot be extended past that (ok, but it was cheap :-)
-* I've tried to show which constants to change by having
-* some kind of marker at them (search for "16Mb"), but I
-* won't guarantee that's all :-( )
+* Memory above 16Mb is mapped later, by paging_init() in
+* mm/memory.c, once main() knows how much there is. The
+* kernel segments below are 1Gb (MAX_MEMORY) to cover it.
+* This pg_dir becomes task 0's; fork gives every other task
+* a directory of its own that shares the kernel part.
+*
+* If the cpu has 4Mb pages (PSE), 4Mb-16Mb is mapped with
+* those, to save TLB entries. The first 4Mb always use pg0:
+* task 0 runs there and the first fork copies its entries,
+* and it has the 640kB-1Mb hole. pg1-pg3 are the fallback.
 */
 .align 2
 setup_paging:
@@ -186,23 +188,66 @@ setup_paging:
         xorl %eax,%eax
         xorl %edi,%edi                  /* pg_dir is at 0x000 */
         cld;rep;stosl
+        call check_pse
+        testl %eax,%eax
+        je 2f
+        movl %cr4,%eax
+        orl $0x10,%eax                  /* PSE */
+        movl %eax,%cr4
         movl $pg0+7,_pg_dir             /* set present bit/user r/w */
+        movl $0x400087,_pg_dir+4        /* 4Mb pages: + page size bit */
+        movl $0x800087,_pg_dir+8
+        movl $0xc00087,_pg_dir+12
+        movl $pg0+4092,%edi
+        movl $0x3ff007,%eax             /*  4Mb - 4096 + 7 (r/w user,p) */
+        std
+1:      stosl
+        subl $0x1000,%eax
+        jge 1b
+        jmp 3f
+2:      movl $pg0+7,_pg_dir             /* set present bit/user r/w */
         movl $pg1+7,_pg_dir+4           /*  --------- " " --------- */
         movl $pg2+7,_pg_dir+8           /*  --------- " " --------- */
         movl $pg3+7,_pg_dir+12          /*  --------- " " --------- */
         movl $pg3+4092,%edi
         movl $0xfff007,%eax             /*  16Mb - 4096 + 7 (r/w user,p) */
         std
-        :      stosl                   /* fill pages backwards - more efficient :-) */
+1:      stosl                   /* fill pages backwards - more efficient :-) */
         subl $0x1000,%eax
         jge 1b
-        xorl %eax,%eax          /* pg_dir is at 0x0000 */
+3:      xorl %eax,%eax          /* pg_dir is at 0x0000 */
         movl %eax,%cr3          /* cr3 - page directory start */
         movl %cr0,%eax
         orl $0x80000000,%eax
         movl %eax,%cr0          /* set paging (PG) bit */
         ret                     /* this also flushes prefetch-queue */
 
+/*
+* check_pse returns non-zero in %eax if the cpu has 4Mb pages.
+* That needs cpuid, which we have if the ID flag in eflags
+* can be changed; cpuid 1 then has PSE in bit 3 of edx.
+*/
+.align 2
+check_pse:
+        pushfl
+        popl %eax
+        movl %eax,%ecx
+        xorl $0x200000,%eax             /* ID flag */
+        pushl %eax
+        popfl
+        pushfl
+        popl %eax
+        pushl %ecx
+        popfl
+        xorl %ecx,%eax
+        andl $0x200000,%eax
+        je 1f                           /* no cpuid */
+        movl $1,%eax
+        cpuid
+        movl %edx,%eax
+        andl $0x8,%eax
+1:      ret
+
 .align 2                        /* 对齐指令,将当前位置调整到一个2的幂次方边界. */
 .word 0                         /* 定义一个16位的数据,值为0,用于填充空间 */
 idt_descr:                      /* 标签,用于标识下面的数据段是中断描述符表的描述符 */
@@ -211,14 +256,14 @@ idt_descr:                      /* 标签,用于标识下面的数据段是中
 .align 2
 .word 0
 gdt_descr:
-        .word 256*8-1           # so does gdt (not that that's any
-        .long _gdt              # magic number, but it works for me :^)
+        .word 1024*8-1          # gdt has room for 510 tasks, see
+        .long _gdt              # NR_GDT_ENTRIES in linux/head.h
 
         .align 3
 _idt:   .fill 256,8,0           # idt is uninitialized
 
 _gdt:   .quad 0x0000000000000000        /* NULL descriptor */
-        .quad 0x00c09a0000000fff        /* 16Mb */
-        .quad 0x00c0920000000fff        /* 16Mb */
+        .quad 0x00c39a000000ffff        /* 1Gb */
+        .quad 0x00c392000000ffff        /* 1Gb */
         .quad 0x0000000000000000        /* TEMPORARY - don't use */
-        .fill 252,8,0                   /* space for LDT's and TSS's etc */
+        .fill 1020,8,0                  /* space for LDT's and TSS's etc */
@@ -46,6 +46,34 @@ start:
         int     0x15
         mov     [2],ax
 
+| Get the memory map (int 0x15, eax=0xE820), if the bios has one. Up to
+| 12 entries of 20 bytes go to 0x90100, their number to 0x901F0. The
+| kernel falls back on the size above if there are none.
+
+        xor     ax,ax
+        mov     [0x1F0],ax
+        push    ds
+        pop     es
+        mov     di,#0x0100
+        xor     ebx,ebx
+e820_next:
+        mov     eax,#0x0000E820
+        mov     edx,#0x534D4150 | "SMAP"
+        mov     ecx,#20
+        int     0x15
+        jc      e820_done
+        cmp     eax,#0x534D4150
+        jne     e820_done
+        mov     ax,[0x1F0]
+        inc     ax
+        mov     [0x1F0],ax
+        cmp     ax,#12
+        jae     e820_done
+        add     di,#20
+        test    ebx,ebx
+        jnz     e820_next
+e820_done:
+
 | Get hd0 data
 
         mov     ax,#0x0000
@@ -42,6 +42,30 @@ __asm__("cld\n" \
         :"=c" (__res):"c" (0),"S" (addr):"ax","dx","si"); \
 __res; })
 
+/*
+ * find_next_zero() returns the first zero bit at or after 'nr' in the
+ * 8192-bit bitmap block at 'addr', or 8192 if there is none.
+ */
+static int find_next_zero(unsigned long *addr, int nr)
+{
+    unsigned long w;
+    int i = nr >> 5;
+
+    if (nr & 31)
+    {
+        if ((w = ~addr[i] & (~0UL << (nr & 31))))
+            goto found;
+        i++;
+    }
+    for (; i < 256; i++)
+        if ((w = ~addr[i]))
+            goto found;
+    return 8192;
+found:
+    __asm__("bsfl %1,%0" : "=r"(nr) : "r"(w));
+    return (i << 5) + nr;
+}
+
 /* 释放设备的block块 */
 void free_block(int dev, int block)
 {
@@ -71,38 +95,62 @@ void free_block(int dev, int block)
         printk("block (%04x:%d) ", dev, block + sb->s_firstdatazone - 1);
         panic("free_block: bit already cleared");
     }
-    sb->s_zmap[block / 8192]->b_dirt = 1; // 将位图缓冲区块标记为脏
+    mark_buffer_dirty(sb->s_zmap[block / 8192]); // 将位图缓冲区块标记为脏
+    sb->s_zfree++;
 }
 
-/* 在指定设备上分配一个新的数据块,并返回该数据块的块号 */
-int new_block(int dev)
+/*
+ * 在指定设备上分配一个新的数据块,并返回该数据块的块号
+ *
+ * The search starts at 'goal' if it is a data zone, else where the last
+ * allocation on the device left off, and goes forward through the zone
+ * bitmap, wrapping around once. The free count lets a full device fail
+ * at once instead of after scanning all of the bitmap.
+ */
+int new_block(int dev, int goal)
 {
     struct buffer_head *bh;
     struct super_block *sb;
-    int i, j;
+    int i, j, n, bit, nbits;
 
     if (!(sb = get_super(dev)))
         panic("trying to get new block from nonexistant device");
-    j = 8192;
-    for (i = 0; i < 8; i++)
-        if (bh = sb->s_zmap[i])
-            if ((j = find_first_zero(bh->b_data)) < 8192)       // bh->b_data 一共有8192个bit位，即1024个byte(char)
-                break;
-    if (i >= 8 || !bh || j >= 8192)
+    if (!sb->s_zfree)
         return 0;
+    nbits = sb->s_nzones - sb->s_firstdatazone + 1;
+    if (goal >= sb->s_firstdatazone && goal < sb->s_nzones)
+        bit = goal - sb->s_firstdatazone + 1;
+    else
+        bit = sb->s_zgoal;
+    if (bit >= nbits)
+        bit = 0;
+    for (n = 0; n <= sb->s_zmap_blocks; n++)
+    {
+        i = bit >> 13;
+        if (!(bh = sb->s_zmap[i]))
+            return 0;
+        j = find_next_zero((unsigned long *)bh->b_data, bit & 8191);
+        if (j < 8192 && j + (i << 13) < nbits)
+            goto found;
+        if ((bit = (i + 1) << 13) >= nbits)
+            bit = 0;
+    }
+    return 0;
+found:
     if (set_bit(j, bh->b_data))
         panic("new_block: bit already set");
-    bh->b_dirt = 1;
-    j += i * 8192 + sb->s_firstdatazone - 1;
-    if (j >= sb->s_nzones)
-        return 0;
+    mark_buffer_dirty(bh);
+    sb->s_zfree--;
+    j += i * 8192;
+    sb->s_zgoal = j + 1;
+    j += sb->s_firstdatazone - 1;
     if (!(bh = getblk(dev, j)))
         panic("new_block: cannot get block");
     if (bh->b_count != 1)
         panic("new block: count is != 1");
     clear_block(bh->b_data);
     bh->b_uptodate = 1;
-    bh->b_dirt = 1;
+    mark_buffer_dirty(bh);
     brelse(bh);
     return j;
 }
@@ -117,7 +165,7 @@ void free_inode(struct m_inode *inode)
         return;
     if (!inode->i_dev) /*  一个有效的inode一定指向某个dev设备 */
     {
-        memset(inode, 0, sizeof(*inode));
+        clear_inode(inode);
         return;
     }
     if (inode->i_count > 1) /* 有其他进程也在使用这个inode */
@@ -135,8 +183,8 @@ void free_inode(struct m_inode *inode)
         panic("nonexistent imap in superblock");
     if (clear_bit(inode->i_num & 8191, bh->b_data))
         panic("free_inode: bit already cleared");
-    bh->b_dirt = 1;
-    memset(inode, 0, sizeof(*inode));
+    mark_buffer_dirty(bh);
+    clear_inode(inode);
 }
 
 struct m_inode *new_inode(int dev)
@@ -162,12 +210,13 @@ struct m_inode *new_inode(int dev)
     }
     if (set_bit(j, bh->b_data))
         panic("new_inode: bit already set");
-    bh->b_dirt = 1;
+    mark_buffer_dirty(bh);
     inode->i_count = 1;
     inode->i_nlinks = 1;
     inode->i_dev = dev;
     inode->i_dirt = 1;
     inode->i_num = j + i * 8192;
+    insert_inode_hash(inode);
     inode->i_mtime = inode->i_atime = inode->i_ctime = CURRENT_TIME;
     return inode;
 }
@@ -26,7 +26,7 @@ int block_write(int dev, long * pos, char * buf, int count)
         if (chars > count) /* 若当前块还可读的数据大于count */
             chars=count;
         if (chars == BLOCK_SIZE) /* 偏移量为0的情况,且count == BLOCK_SIZE */
-            bh = getblk(dev,block); /* 读取一个block即可,读取dev与block决定的buffer_head */
+            bh = getblk_overwrite(dev,block); /* 整块覆盖写,不必先读出旧数据 */
         else
             bh = breada(dev,block,block+1,block+2,-1); /* 当前block剩余可读的数量小于count，进行预读操作，获取当前块和接下来两个块的缓冲块 */
         block++;
@@ -37,9 +37,12 @@ int block_write(int dev, long * pos, char * buf, int count)
         *pos += chars; /*这里提前就更新了文件位置指针，往后移动chars个字节 */
         written += chars;
         count -= chars;
-        while (chars-->0) /* 实际从buf读数据，在block写数据发生在这里 */
-            *(p++) = get_fs_byte(buf++); /* 这个是用汇编写的，功能就是从指定位置读取一个字节 */
-        bh->b_dirt = 1;
+        copy_from_user(p, buf, chars); /* 实际从buf读数据，在block写数据发生在这里 */
+        buf += chars;
+        bh->b_uptodate = 1;
+        mark_buffer_dirty(bh);
+        if (chars == BLOCK_SIZE) /* getblk_overwrite() 返回的缓冲块是加锁的 */
+            end_overwrite(bh);
         brelse(bh);
     }
     return written;
@@ -67,8 +70,8 @@ int block_read(int dev, unsigned long * pos, char * buf, int count)
         *pos += chars;
         read += chars;
         count -= chars;
-        while (chars-->0)
-            put_fs_byte(*(p++),buf++); /* 将p处的字节放到buf处 */
+        copy_to_user(buf, p, chars); /* 将p处的数据放到buf处 */
+        buf += chars;
         brelse(bh);
     }
     return read;
@@ -19,20 +19,71 @@
  */
 
 #include "../include/stdarg.h"
+#include "../include/errno.h"
 #include "../include/linux/fs.h"
 #include "../include/linux/config.h"
 #include "../include/linux/sched.h"
 #include "../include/linux/kernel.h"
 #include "../include/asm/system.h"
 #include "../include/asm/io.h"
+#include "../include/asm/segment.h"
 
 extern int end;
 struct buffer_head *start_buffer = (struct buffer_head *)&end;
 struct buffer_head *hash_table[NR_HASH];
-static struct buffer_head *free_list;
 static struct task_struct *buffer_wait = NULL;
 int NR_BUFFERS = 0;
 
+/*
+ * Unused buffers (b_count==0) live on one of three circular lru lists,
+ * depending on their state when they were released: least recently
+ * used at the head, most recently released at the tail. Buffers in use
+ * are on no list at all, so getblk() never has to step over them.
+ */
+#define BUF_CLEAN 0
+#define BUF_DIRTY 1
+#define BUF_LOCKED 2
+#define NR_LIST 3
+
+#define BUF_STATE(bh) ((bh)->b_lock ? BUF_LOCKED : \
+                       ((bh)->b_dirt ? BUF_DIRTY : BUF_CLEAN))
+
+static struct buffer_head *lru_list[NR_LIST] = {NULL, NULL, NULL};
+static int nr_lru[NR_LIST] = {0, 0, 0};
+
+/*
+ * Tunables of the writeback daemon, see sys_bdflush():
+ *  0 - age (in jiffies) after which a dirty buffer is written back
+ *  1 - percentage of the cache that may sit dirty before it wakes early
+ *  2 - interval (in jiffies) between its periodic wakeups
+ */
+#define NR_BDF_PARAM 3
+static long bdf_prm[NR_BDF_PARAM] = {30 * HZ, 40, 5 * HZ};
+static long bdf_min[NR_BDF_PARAM] = {HZ, 1, HZ / 10};
+static long bdf_max[NR_BDF_PARAM] = {600 * HZ, 100, 60 * HZ};
+
+#define bdf_age (bdf_prm[0])
+#define bdf_ratio (bdf_prm[1])
+#define bdf_interval (bdf_prm[2])
+
+#define too_many_dirty() (nr_lru[BUF_DIRTY] * 100 > bdf_ratio * NR_BUFFERS)
+
+static struct task_struct *bdflush_wait = NULL;
+static int bdflush_running = 0;
+static int bdflush_timer = 0;
+
+/*
+ * Every dirty buffer is also on the dirty list of its major device,
+ * sorted by (device, block), so that syncing costs O(dirty) and the
+ * writes reach ll_rw_block() in sector order. Buffers cleaned by the
+ * drivers stay on it until the next sync walks past them.
+ */
+static struct buffer_head *dirty_list[NR_BLK_DEV];
+
+#define DIRTY_ORDER(b1, b2) ((b1)->b_dev < (b2)->b_dev || \
+                             ((b1)->b_dev == (b2)->b_dev && \
+                              (b1)->b_blocknr < (b2)->b_blocknr))
+
 static inline void wait_on_buffer(struct buffer_head *bh)
 {
     cli();
@@ -41,46 +92,130 @@ static inline void wait_on_buffer(struct buffer_head *bh)
     sti();
 }
 
-int sys_sync(void)
+static inline void remove_dirty(struct buffer_head *bh)
 {
-    int i;
-    struct buffer_head *bh;
+    struct buffer_head **list = dirty_list + MAJOR(bh->b_dev);
 
-    sync_inodes(); /* write out inodes into buffers */
-    bh = start_buffer;
-    for (i = 0; i < NR_BUFFERS; i++, bh++)
+    if (bh->b_next_dirty == bh)
+        *list = NULL;
+    else
     {
-        wait_on_buffer(bh);
-        if (bh->b_dirt)
-            ll_rw_block(WRITE, bh);
+        bh->b_prev_dirty->b_next_dirty = bh->b_next_dirty;
+        bh->b_next_dirty->b_prev_dirty = bh->b_prev_dirty;
+        if (*list == bh)
+            *list = bh->b_next_dirty;
     }
-    return 0;
+    bh->b_next_dirty = bh->b_prev_dirty = NULL;
 }
 
-int sync_dev(int dev)
+static inline void insert_dirty(struct buffer_head *bh)
 {
-    int i;
-    struct buffer_head *bh;
+    struct buffer_head **list = dirty_list + MAJOR(bh->b_dev);
+    struct buffer_head *tmp;
 
-    bh = start_buffer;
-    for (i = 0; i < NR_BUFFERS; i++, bh++)
+    if (!*list)
     {
-        if (bh->b_dev != dev)
-            continue;
-        wait_on_buffer(bh);
-        if (bh->b_dev == dev && bh->b_dirt)
-            ll_rw_block(WRITE, bh);
+        *list = bh->b_next_dirty = bh->b_prev_dirty = bh;
+        return;
     }
-    sync_inodes();
-    bh = start_buffer;
-    for (i = 0; i < NR_BUFFERS; i++, bh++)
+    /* blocks are mostly dirtied in ascending order: search from the tail */
+    tmp = (*list)->b_prev_dirty;
+    while (tmp != *list && DIRTY_ORDER(bh, tmp))
+        tmp = tmp->b_prev_dirty;
+    if (DIRTY_ORDER(bh, tmp))
+    {
+        tmp = tmp->b_prev_dirty;
+        *list = bh;
+    }
+    bh->b_prev_dirty = tmp;
+    bh->b_next_dirty = tmp->b_next_dirty;
+    tmp->b_next_dirty->b_prev_dirty = bh;
+    tmp->b_next_dirty = bh;
+}
+
+/*
+ * Buffers have to be dirtied through here, so that they get on the
+ * dirty list of their device.
+ */
+void mark_buffer_dirty(struct buffer_head *bh)
+{
+    if (!bh->b_dirt)
+        bh->b_flushtime = jiffies + bdf_age;
+    bh->b_dirt = 1;
+    if (!bh->b_next_dirty)
+        insert_dirty(bh);
+}
+
+/*
+ * find_dirty() returns the first buffer on the dirty list of 'major'
+ * that doesn't sort before (dev, block), or NULL.
+ */
+static struct buffer_head *find_dirty(int major, int dev, int block)
+{
+    struct buffer_head *bh;
+
+    if (!(bh = dirty_list[major]))
+        return NULL;
+    do
+    {
+        if (bh->b_dev > dev || (bh->b_dev == dev && bh->b_blocknr >= block))
+            return bh;
+    } while ((bh = bh->b_next_dirty) != dirty_list[major]);
+    return NULL;
+}
+
+/*
+ * Writes the dirty buffers of 'dev' (all devices if dev==0) in block
+ * order. Each buffer is taken off the list before it is written. As
+ * ll_rw_block() can sleep, the next buffer may have left the list by
+ * the time we get back, in which case we find our place again by
+ * (dev, block) instead of starting over.
+ */
+static void write_dirty_buffers(int dev)
+{
+    struct buffer_head *bh, *next;
+    int major, ndev = 0, nblock = 0;
+
+    for (major = 0; major < NR_BLK_DEV; major++)
     {
-        if (bh->b_dev != dev)
+        if (dev && major != MAJOR(dev))
             continue;
-        wait_on_buffer(bh);
-        if (bh->b_dev == dev && bh->b_dirt)
+        for (bh = dirty_list[major]; bh; bh = next)
+        {
+            if ((next = bh->b_next_dirty) == dirty_list[major])
+                next = NULL;
+            if (dev && bh->b_dev < dev)
+                continue;
+            if (dev && bh->b_dev > dev)
+                break;
+            if (next)
+            {
+                ndev = next->b_dev;
+                nblock = next->b_blocknr;
+            }
+            remove_dirty(bh);
+            if (!bh->b_dirt)
+                continue;
             ll_rw_block(WRITE, bh);
+            if (next && (!next->b_next_dirty || next->b_dev != ndev ||
+                         next->b_blocknr != nblock))
+                next = find_dirty(major, ndev, nblock);
+        }
     }
+}
+
+int sys_sync(void)
+{
+    sync_inodes(); /* write out inodes into buffers */
+    write_dirty_buffers(0);
+    return 0;
+}
+
+int sync_dev(int dev)
+{
+    write_dirty_buffers(dev);
+    sync_inodes();
+    write_dirty_buffers(dev);
     return 0;
 }
 
@@ -97,6 +232,10 @@ int sync_dev(int dev)
  * that any additional removable block-device will use this routine,
  * and that mount/open needn't know that floppies/whatever are
  * special.
+ *
+ * The scan over the whole cache is only done once the medium really
+ * has changed. Dirty buffers it cleans just drop off the dirty list
+ * at the next sync.
  */
 void check_disk_change(int dev)
 {
@@ -135,22 +274,10 @@ static inline void remove_from_queues(struct buffer_head *bh)
         bh->b_prev->b_next = bh->b_next;
     if (hash(bh->b_dev, bh->b_blocknr) == bh)
         hash(bh->b_dev, bh->b_blocknr) = bh->b_next;
-    /* remove from free list */
-    if (!(bh->b_prev_free) || !(bh->b_next_free))
-        panic("Free block list corrupted");
-    bh->b_prev_free->b_next_free = bh->b_next_free;
-    bh->b_next_free->b_prev_free = bh->b_prev_free;
-    if (free_list == bh)
-        free_list = bh->b_next_free;
 }
 
 static inline void insert_into_queues(struct buffer_head *bh)
 {
-    /* put at end of free list */
-    bh->b_next_free = free_list;
-    bh->b_prev_free = free_list->b_prev_free;
-    free_list->b_prev_free->b_next_free = bh;
-    free_list->b_prev_free = bh;
     /* put the buffer in new hash-queue if it has a device */
     bh->b_prev = NULL;
     bh->b_next = NULL;
@@ -158,7 +285,90 @@ static inline void insert_into_queues(struct buffer_head *bh)
         return;
     bh->b_next = hash(bh->b_dev, bh->b_blocknr);
     hash(bh->b_dev, bh->b_blocknr) = bh;
-    bh->b_next->b_prev = bh;
+    if (bh->b_next)
+        bh->b_next->b_prev = bh;
+}
+
+static inline void remove_from_lru(struct buffer_head *bh)
+{
+    struct buffer_head **list;
+
+    if (bh->b_list >= NR_LIST)
+        return;
+    list = lru_list + bh->b_list;
+    if (!(bh->b_prev_free) || !(bh->b_next_free))
+        panic("Free block list corrupted");
+    if (bh->b_next_free == bh)
+        *list = NULL;
+    else
+    {
+        bh->b_prev_free->b_next_free = bh->b_next_free;
+        bh->b_next_free->b_prev_free = bh->b_prev_free;
+        if (*list == bh)
+            *list = bh->b_next_free;
+    }
+    bh->b_next_free = bh->b_prev_free = NULL;
+    nr_lru[bh->b_list]--;
+    bh->b_list = NR_LIST;
+}
+
+/* put a free buffer at the most-recently-used end of the list for its state */
+static inline void put_last_lru(struct buffer_head *bh)
+{
+    struct buffer_head **list;
+
+    bh->b_list = BUF_STATE(bh);
+    if (bh->b_list == BUF_DIRTY && too_many_dirty())
+        wake_up(&bdflush_wait);
+    nr_lru[bh->b_list]++;
+    list = lru_list + bh->b_list;
+    if (!*list)
+    {
+        *list = bh->b_next_free = bh->b_prev_free = bh;
+        return;
+    }
+    bh->b_next_free = *list;
+    bh->b_prev_free = (*list)->b_prev_free;
+    (*list)->b_prev_free->b_next_free = bh;
+    (*list)->b_prev_free = bh;
+}
+
+/*
+ * Buffers change state behind our back (interrupts unlock them, the
+ * drivers clean them), so the lists are only refiled lazily: whenever
+ * a list head turns out to be in the wrong list it is moved on.
+ */
+static inline void refile_buffer(struct buffer_head *bh)
+{
+    remove_from_lru(bh);
+    put_last_lru(bh);
+}
+
+/*
+ * Drops a reference without waiting for the buffer. The last user
+ * puts it back on the lru lists.
+ */
+static inline void put_buffer(struct buffer_head *bh)
+{
+    if (!(bh->b_count--))
+        panic("Trying to free free buffer");
+    if (!bh->b_count)
+        put_last_lru(bh);
+    wake_up(&buffer_wait);
+}
+
+/*
+ * Starts writing out a dirty free buffer. We hold it while
+ * ll_rw_block() sleeps, so nobody can reuse it under us.
+ */
+static void write_lru_buffer(struct buffer_head *bh)
+{
+    remove_from_lru(bh);
+    if (bh->b_next_dirty)
+        remove_dirty(bh);
+    bh->b_count++;
+    ll_rw_block(WRITE, bh);
+    put_buffer(bh);
 }
 
 static struct buffer_head *find_buffer(int dev, int block)
@@ -186,62 +396,66 @@ struct buffer_head *get_hash_table(int dev, int block)
     {
         if (!(bh = find_buffer(dev, block)))
             return NULL;
-        bh->b_count++;
+        if (!bh->b_count++)
+            remove_from_lru(bh);
         wait_on_buffer(bh);
         if (bh->b_dev == dev && bh->b_blocknr == block)
             return bh;
-        bh->b_count--;
+        put_buffer(bh);
     }
 }
 
+/*
+ * get_lru_buffer() returns the least recently used clean and unlocked
+ * free buffer, or NULL if there is none. Stale list heads are refiled
+ * on the way, so this is (amortized) constant time.
+ */
+static struct buffer_head *get_lru_buffer(void)
+{
+    struct buffer_head *bh;
+    int i;
+
+    for (i = 0; i < NR_LIST; i++)
+        while ((bh = lru_list[i]) && BUF_STATE(bh) != i)
+            refile_buffer(bh);
+    return lru_list[BUF_CLEAN];
+}
+
 /*
  * Ok, this is getblk, and it isn't very clear, again to hinder
  * race-conditions. Most of the code is seldom used, (ie repeating),
  * so it should be much more efficient than it looks.
  */
-/* 计算缓冲块的"坏度", 通过将脏标志位左移1位加上锁标志位来计算"坏度".通过这个值可以评估缓冲块的状态 */
-#define BADNESS(bh) (((bh)->b_dirt << 1) + (bh)->b_lock)
-
 struct buffer_head *getblk(int dev, int block)
 {
-    struct buffer_head *tmp, *bh;
+    struct buffer_head *bh;
 
 repeat:
     if (bh = get_hash_table(dev, block))
         return bh;
-    tmp = free_list;
-    do
+    if (!(bh = get_lru_buffer()))
     {
-        if (tmp->b_count) // 正在使用
-            continue;
-        if (!bh || BADNESS(tmp) < BADNESS(bh))
+        /*
+         * Every free buffer is dirty or under I/O. The writeback daemon
+         * should have prevented that: kick it, and clean the oldest
+         * buffer ourselves instead of flushing the whole device.
+         */
+        if ((bh = lru_list[BUF_DIRTY]))
         {
-            bh = tmp;
-            if (!BADNESS(tmp))
-                break;
+            wake_up(&bdflush_wait);
+            write_lru_buffer(bh);
         }
-    } while ((tmp = tmp->b_next_free) != free_list);
-    if (!bh)
-    {
-        sleep_on(&buffer_wait);
+        else if ((bh = lru_list[BUF_LOCKED]))
+            wait_on_buffer(bh);
+        else
+            sleep_on(&buffer_wait);
         goto repeat;
     }
-    wait_on_buffer(bh);
-    if (bh->b_count)
-        goto repeat;
-    while (bh->b_dirt)
-    {
-        sync_dev(bh->b_dev);
-        wait_on_buffer(bh);
-        if (bh->b_count)
-            goto repeat;
-    }
-    /* NOTE!! While we slept waiting for this block, somebody else might */
-    /* already have added "this" block to the cache. check it */
-    if (find_buffer(dev, block))
-        goto repeat;
     /* OK, FINALLY we know that this buffer is the only one of it's kind, */
     /* and that it's unused (b_count=0), unlocked (b_lock=0), and clean */
+    remove_from_lru(bh);
+    if (bh->b_next_dirty)
+        remove_dirty(bh);
     bh->b_count = 1;
     bh->b_dirt = 0;
     bh->b_uptodate = 0;
@@ -258,9 +472,36 @@ void brelse(struct buffer_head *buf)
     if (!buf)
         return;
     wait_on_buffer(buf);
-    if (!(buf->b_count--))
-        panic("Trying to free free buffer");
-    wake_up(&buffer_wait);
+    put_buffer(buf);
+}
+
+/*
+ * getblk_overwrite() is getblk() for a block that the caller is going to
+ * overwrite as a whole, so there is no point in reading it. A read that
+ * is already under way has to finish though, or it would overwrite the
+ * new data. The buffer is returned locked: copying the data in can sleep
+ * on a page fault, and a bread() of the block in the meantime must not
+ * start a read of the old contents. The caller sets b_uptodate once the
+ * data is in and then calls end_overwrite().
+ */
+struct buffer_head *getblk_overwrite(int dev, int block)
+{
+    struct buffer_head *bh;
+
+    if (!(bh = getblk(dev, block)))
+        return NULL;
+    cli();
+    while (bh->b_lock)
+        sleep_on(&bh->b_wait);
+    bh->b_lock = 1;
+    sti();
+    return bh;
+}
+
+void end_overwrite(struct buffer_head *bh)
+{
+    bh->b_lock = 0;
+    wake_up(&bh->b_wait);
 }
 
 /*
@@ -289,10 +530,25 @@ struct buffer_head *bread(int dev, int block)
  * number.
  * 这个函数其实是读取第一个块的缓冲区，并从硬盘预读第二、三...个块的数据到缓冲区中
  */
+/*
+ * bread_async() starts reading a block into the cache, if it isn't
+ * there yet, and returns without waiting for it.
+ */
+void bread_async(int dev, int block)
+{
+    struct buffer_head *bh;
+
+    if (!(bh = getblk(dev, block)))
+        return;
+    if (!bh->b_uptodate)
+        ll_rw_block(READA, bh);
+    put_buffer(bh);
+}
+
 struct buffer_head *breada(int dev, int first, ...)
 {
     va_list args;
-    struct buffer_head *bh, *tmp;
+    struct buffer_head *bh;
 
     va_start(args, first);
     if (!(bh = getblk(dev, first)))
@@ -300,15 +556,7 @@ struct buffer_head *breada(int dev, int first, ...)
     if (!bh->b_uptodate)     /* 如果缓冲块的数据不是最新的 */
         ll_rw_block(READ, bh);
     while ((first = va_arg(args, int)) >= 0)
-    {
-        tmp = getblk(dev, first);
-        if (tmp)
-        {
-            if (!tmp->b_uptodate)
-                ll_rw_block(READA, bh);
-            tmp->b_count--;
-        }
-    }
+        bread_async(dev, first);
     va_end(args);
     wait_on_buffer(bh);
     if (bh->b_uptodate)
@@ -317,6 +565,42 @@ struct buffer_head *breada(int dev, int first, ...)
     return (NULL);
 }
 
+#define COPYBLK(from, to)                     \
+    __asm__("cld\n\t"                         \
+            "rep\n\t"                         \
+            "movsl\n\t" ::"c"(BLOCK_SIZE / 4), \
+            "S"(from), "D"(to)                \
+            : "cx", "di", "si")
+
+/*
+ * bread_page() reads four buffers into memory at the desired address.
+ * All four reads are started before we wait for any of them, so they
+ * can go out as one request. A zero block number (a hole) or a block
+ * that can't be read leaves that part of the page untouched.
+ */
+void bread_page(unsigned long address, int dev, int b[4])
+{
+    struct buffer_head *bh[4];
+    int i;
+
+    for (i = 0; i < 4; i++)
+        if (b[i])
+        {
+            if ((bh[i] = getblk(dev, b[i])) && !bh[i]->b_uptodate)
+                ll_rw_block(READ, bh[i]);
+        }
+        else
+            bh[i] = NULL;
+    for (i = 0; i < 4; i++, address += BLOCK_SIZE)
+        if (bh[i])
+        {
+            wait_on_buffer(bh[i]);
+            if (bh[i]->b_uptodate)
+                COPYBLK((unsigned long)bh[i]->b_data, address);
+            brelse(bh[i]);
+        }
+}
+
 void buffer_init(long buffer_end)
 {
     struct buffer_head *h = start_buffer;
@@ -337,18 +621,114 @@ void buffer_init(long buffer_end)
         h->b_wait = NULL;
         h->b_next = NULL;
         h->b_prev = NULL;
+        h->b_next_dirty = h->b_prev_dirty = NULL;
+        h->b_reqnext = NULL;
         h->b_data = (char *)b;
-        h->b_prev_free = h - 1;
-        h->b_next_free = h + 1;
+        put_last_lru(h);
         h++;
         NR_BUFFERS++;
         if (b == (void *)0x100000)
             b = (void *)0xA0000;
     }
-    h--;
-    free_list = start_buffer;
-    free_list->b_prev_free = h;
-    h->b_next_free = free_list;
     for (i = 0; i < NR_HASH; i++)
         hash_table[i] = NULL;
 }
+
+/*
+ * flush_old_buffers() starts writeback of the free dirty buffers that
+ * are older than bdf_age, or of any of them while too much of the cache
+ * is dirty. The dirty lru list is in release order, but b_flushtime is
+ * set when a buffer is first dirtied, so an old buffer can sit behind a
+ * young one: the whole list is scanned, and young buffers are rotated to
+ * the tail, which keeps their lru order. Returns the number of writes
+ * started.
+ */
+static int flush_old_buffers(void)
+{
+    struct buffer_head *bh;
+    int nr, written = 0;
+
+    for (nr = nr_lru[BUF_DIRTY]; nr-- > 0 && (bh = lru_list[BUF_DIRTY]);)
+    {
+        if (BUF_STATE(bh) != BUF_DIRTY)
+        {
+            refile_buffer(bh);
+            continue;
+        }
+        if (bh->b_flushtime > jiffies && !too_many_dirty())
+        {
+            lru_list[BUF_DIRTY] = bh->b_next_free;
+            continue;
+        }
+        write_lru_buffer(bh);
+        written++;
+    }
+    return written;
+}
+
+static void bdflush_timeout(void)
+{
+    bdflush_timer = 0;
+    wake_up(&bdflush_wait);
+}
+
+/*
+ * sys_bdflush() is the interface to the writeback daemon:
+ *
+ *   func == 0   the caller becomes the daemon (superuser, never returns)
+ *   func == 1   do a single writeback pass now
+ *   func >= 2   parameter (func-2)/2 is read into *data if func is even,
+ *               or set to data if it is odd (superuser)
+ *
+ * init() forks the daemon at boot, so foreground getblk() callers find
+ * clean buffers instead of having to write them out themselves.
+ */
+int sys_bdflush(int func, long data)
+{
+    int i;
+
+    if (!func)
+    {
+        if (!suser())
+            return -EPERM;
+        if (bdflush_running)
+            return -EBUSY;
+        bdflush_running = 1;
+        for (;;)
+        {
+            if (flush_old_buffers() && too_many_dirty())
+                continue;
+            if (!bdflush_timer)
+            {
+                bdflush_timer = 1;
+                add_timer(bdf_interval, bdflush_timeout);
+            }
+            cli();
+            if (bdflush_timer)
+                sleep_on(&bdflush_wait);
+            sti();
+        }
+    }
+    if (func == 1)
+    {
+        if (!suser())
+            return -EPERM;
+        flush_old_buffers();
+        return 0;
+    }
+    i = (func - 2) >> 1;
+    if (i < 0 || i >= NR_BDF_PARAM)
+        return -EINVAL;
+    if (!(func & 1))
+    {
+        verify_area((void *)data, 4);
+        put_fs_long(bdf_prm[i], (unsigned long *)data);
+        return 0;
+    }
+    if (!suser())
+        return -EPERM;
+    if (data < bdf_min[i] || data > bdf_max[i])
+        return -EINVAL;
+    bdf_prm[i] = data;
+    return 0;
+}
@@ -14,7 +14,6 @@
 #include "../include/linux/mm.h"
 #include "../include/asm/segment.h"
 
-extern int sys_exit(int exit_code);
 extern int sys_close(int fd);
 
 /*
@@ -24,104 +23,6 @@ extern int sys_close(int fd);
  */
 #define MAX_ARG_PAGES 32
 
-/* 汇编级别内存块的复制操作 */
-#define cp_block(from, to)                    \
-    __asm__("pushl $0x10\n\t"                 \
-            "pushl $0x17\n\t"                 \
-            "pop %%es\n\t"                    \
-            "cld\n\t"                         \
-            "rep\n\t"                         \
-            "movsl\n\t"                       \
-            "pop %%es" ::"c"(BLOCK_SIZE / 4), \
-            "S"(from), "D"(to)                \
-            : "cx", "di", "si")
-
-/*
- * read_head() reads blocks 1-6 (not 0). Block 0 has already been
- * read for header information.
- */
-int read_head(struct m_inode *inode, int blocks)
-{
-    struct buffer_head *bh;
-    int count;
-
-    if (blocks > 6)
-        blocks = 6;
-    for (count = 0; count < blocks; count++)
-    {
-        if (!inode->i_zone[count + 1]) // inode->i_zone[count + 1] 存的是block号码，一个inode最多存10个block号码，对应硬盘中的10个block
-            continue;
-        if (!(bh = bread(inode->i_dev, inode->i_zone[count + 1])))
-            return -1;
-        cp_block(bh->b_data, count * BLOCK_SIZE);  /* 将数据从硬盘的block块对应的buffer_head的b_data字段拷贝到内存，以1024字节为单位 */
-        brelse(bh);
-    }
-    return 0;
-}
-
-/* 从间接块读取数据 dev-设备号 ind-间接块的块号 size-读取的数据大小 offset-内存的偏移位置 */
-int read_ind(int dev, int ind, long size, unsigned long offset)
-{
-    struct buffer_head *ih, *bh;
-    unsigned short *table, block;
-
-    if (size <= 0)
-        panic("size<=0 in read_ind");
-    if (size > 512 * BLOCK_SIZE)
-        size = 512 * BLOCK_SIZE;
-    if (!ind)
-        return 0;
-    if (!(ih = bread(dev, ind)))
-        return -1;
-    table = (unsigned short *)ih->b_data;
-    while (size > 0)
-    {
-        if (block = *(table++))
-            if (!(bh = bread(dev, block)))
-            {
-                brelse(ih);
-                return -1;
-            }
-            else
-            {
-                cp_block(bh->b_data, offset);
-                brelse(bh);
-            }
-        size -= BLOCK_SIZE;
-        offset += BLOCK_SIZE;
-    }
-    brelse(ih);
-    return 0;
-}
-
-/*
- * read_area() reads an area into %fs:mem.
- */
-int read_area(struct m_inode *inode, long size)
-{
-    struct buffer_head *dind;
-    unsigned short *table;
-    int i, count;
-
-    if ((i = read_head(inode, (size + BLOCK_SIZE - 1) / BLOCK_SIZE)) ||
-        (size -= BLOCK_SIZE * 6) <= 0)
-        return i;
-    if ((i = read_ind(inode->i_dev, inode->i_zone[7], size, BLOCK_SIZE * 6)) ||
-        (size -= BLOCK_SIZE * 512) <= 0)
-        return i;
-    if (!(i = inode->i_zone[8]))
-        return 0;
-    if (!(dind = bread(inode->i_dev, i)))
-        return -1;
-    table = (unsigned short *)dind->b_data;
-    for (count = 0; count < 512; count++)
-        if ((i = read_ind(inode->i_dev, *(table++), size,
-                          BLOCK_SIZE * (518 + count))) ||
-            (size -= BLOCK_SIZE * 512) <= 0)
-            return i;
-    panic("Impossibly long executable");
-}
-
 /*
  * create_tables() parses the env- and arg-strings in new user
  * memory and creates the pointer tables from them, and puts their
@@ -140,6 +41,7 @@ static unsigned long *create_tables(char *p, int argc, int envc)
     envp = sp; /* 环境变量表指针 */
     sp -= argc + 1;
     argv = sp;  /* 参数变量表指针 */
+    verify_area(sp - 3, (argc + envc + 5) * 4); /* 下面要写入的 3 + argc+1 + envc+1 个长字 */
     put_fs_long((unsigned long)envp, --sp);
     put_fs_long((unsigned long)argv, --sp);
     put_fs_long((unsigned long)argc, --sp);
@@ -258,7 +160,7 @@ static unsigned long change_ldt(unsigned long text_size, unsigned long *page)
 
     code_limit = text_size + PAGE_SIZE - 1; /* 计算代码段限长*/
     code_limit &= 0xFFFFF000;  /* 按照页面对齐进行截断 */
-    data_limit = 0x4000000;      /* 设置数据段限长 */
+    data_limit = TASK_SIZE;      /* 设置数据段限长 */
     code_base = get_base(current->ldt[1]); /* 获取当前进程的代码段基址 */
     data_base = code_base; /* 将数据段基址设置为与代码段基址相同 */
     set_base(current->ldt[1], code_base); /* 设置当前进程的代码段基址 */
@@ -293,6 +195,7 @@ int do_execve(unsigned long *eip, long tmp, char *filename,
     int sh_bang = 0;
     char *buf = 0;
     unsigned long p = PAGE_SIZE * MAX_ARG_PAGES - 4;
+    unsigned long pgd = 0;
 
     if ((0xffff & eip[1]) != 0x000f)
         panic("execve called from supervisor mode");
@@ -414,7 +317,7 @@ restart_interp:
     }
     brelse(bh);
     if (N_MAGIC(ex) != ZMAGIC || ex.a_trsize || ex.a_drsize ||
-        ex.a_text + ex.a_data + ex.a_bss > 0x3000000 ||
+        ex.a_text + ex.a_data + ex.a_bss > TASK_SIZE / 4 * 3 ||
         inode->i_size < ex.a_text + ex.a_data + ex.a_syms + N_TXTOFF(ex))
     {
         retval = -ENOEXEC;
@@ -436,6 +339,11 @@ restart_interp:
             goto exec_error2;
         }
     }
+    if (current->vfork && !(pgd = get_page_dir()))
+    {
+        retval = -ENOMEM;
+        goto exec_error2;
+    }
     /* OK, This is the point of no return */
     if (buf)
         free_s(buf, 1024);
@@ -445,8 +353,18 @@ restart_interp:
         if ((current->close_on_exec >> i) & 1)
             sys_close(i);
     current->close_on_exec = 0;
-    free_page_tables(get_base(current->ldt[1]), get_limit(0x0f));
-    free_page_tables(get_base(current->ldt[2]), get_limit(0x17));
+    if (current->vfork)
+    {
+        /* hand the parent its memory back, and start out on our own */
+        current->tss.cr3 = pgd;
+        __asm__("movl %0,%%cr3" ::"r"(pgd));
+        end_vfork();
+    }
+    else
+    {
+        free_page_tables(current->tss.cr3, get_base(current->ldt[1]), get_limit(0x0f));
+        free_page_tables(current->tss.cr3, get_base(current->ldt[2]), get_limit(0x17));
+    }
     if (last_task_used_math == current)
         last_task_used_math = NULL;
     current->used_math = 0;
@@ -458,13 +376,12 @@ restart_interp:
     current->start_stack = p & 0xfffff000;
     current->euid = e_uid;
     current->egid = e_gid;
-    i = read_area(inode, ex.a_text + ex.a_data);
-    iput(inode);
-    if (i < 0)
-        sys_exit(-1);
-    i = ex.a_text + ex.a_data;
-    while (i & 0xfff)
-        put_fs_byte(0, (char *)(i++));
+    /*
+     * Text and data aren't read here: do_no_page() pulls them in from
+     * the executable a page at a time as they are touched.
+     */
+    iput(current->executable);
+    current->executable = inode;
     eip[0] = ex.a_entry; /* eip, magic happens :-) */
     eip[3] = p;          /* stack pointer */
     return 0;
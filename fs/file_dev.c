@@ -14,6 +14,40 @@
 #define MIN(a, b) (((a) < (b)) ? (a) : (b))
 #define MAX(a, b) (((a) > (b)) ? (a) : (b))
 
+/*
+ * Readahead. A file that is read block after block gets a window of
+ * blocks read ahead asynchronously, starting at RA_MIN and doubling up
+ * to RA_MAX each time the reader has used up half of it. Reading any
+ * other block than the next one (or the same one again) closes the
+ * window, until the reader goes sequential again.
+ */
+#define RA_MIN 4
+#define RA_MAX 32
+
+static void file_readahead(struct m_inode *inode, struct file *filp, int block)
+{
+    int nr, last, zone;
+
+    if (block + 1 == filp->f_ra_next)
+        return;
+    if (block != filp->f_ra_next)
+    {
+        filp->f_ra_win = 0;
+        filp->f_ra_next = filp->f_ra_end = block + 1;
+        return;
+    }
+    filp->f_ra_next = block + 1;
+    if (filp->f_ra_win && filp->f_ra_end > block + filp->f_ra_win / 2)
+        return;
+    filp->f_ra_win = filp->f_ra_win ? MIN(2 * filp->f_ra_win, RA_MAX) : RA_MIN;
+    last = (inode->i_size - 1) / BLOCK_SIZE;
+    for (nr = MAX(filp->f_ra_end, block + 1);
+         nr <= block + filp->f_ra_win && nr <= last; nr++)
+        if ((zone = bmap(inode, nr)))
+            bread_async(inode->i_dev, zone);
+    filp->f_ra_end = nr;
+}
+
 int file_read(struct m_inode *inode, struct file *filp, char *buf, int count)
 {
     int left, chars, nr;
@@ -23,6 +57,7 @@ int file_read(struct m_inode *inode, struct file *filp, char *buf, int count)
         return 0;
     while (left)
     {
+        file_readahead(inode, filp, filp->f_pos / BLOCK_SIZE);
         if (nr = bmap(inode, (filp->f_pos) / BLOCK_SIZE))
         {
             if (!(bh = bread(inode->i_dev, nr)))
@@ -36,15 +71,14 @@ int file_read(struct m_inode *inode, struct file *filp, char *buf, int count)
         left -= chars;
         if (bh)
         {
-            char *p = nr + bh->b_data;
-            while (chars-- > 0)
-                put_fs_byte(*(p++), buf++);
+            copy_to_user(buf, nr + bh->b_data, chars);
+            buf += chars;
             brelse(bh);
         }
         else
         {
-            while (chars-- > 0)
-                put_fs_byte(0, buf++);
+            clear_user(buf, chars);
+            buf += chars;
         }
     }
     inode->i_atime = CURRENT_TIME;
@@ -57,7 +91,7 @@ int file_write(struct m_inode *inode, struct file *filp, char *buf, int count)
     int block, c;
     struct buffer_head *bh;
     char *p;
-    int i = 0;
+    int i = 0, whole;
 
     /*
      * ok, append may not work when many processes are writing at the same time
@@ -71,11 +105,15 @@ int file_write(struct m_inode *inode, struct file *filp, char *buf, int count)
     {
         if (!(block = create_block(inode, pos / BLOCK_SIZE)))
             break;
-        if (!(bh = bread(inode->i_dev, block)))
-            break;
         c = pos % BLOCK_SIZE;
+        /* a write of the whole block doesn't need the old contents */
+        if ((whole = (!c && count - i >= BLOCK_SIZE)))
+            bh = getblk_overwrite(inode->i_dev, block);
+        else
+            bh = bread(inode->i_dev, block);
+        if (!bh)
+            break;
         p = c + bh->b_data;
-        bh->b_dirt = 1;
         c = BLOCK_SIZE - c;
         if (c > count - i)
             c = count - i;
@@ -86,8 +124,12 @@ int file_write(struct m_inode *inode, struct file *filp, char *buf, int count)
             inode->i_dirt = 1;
         }
         i += c;
-        while (c-- > 0)
-            *(p++) = get_fs_byte(buf++);
+        copy_from_user(p, buf, c);
+        buf += c;
+        bh->b_uptodate = 1;
+        mark_buffer_dirty(bh);
+        if (whole)
+            end_overwrite(bh);
         brelse(bh);
     }
     inode->i_mtime = CURRENT_TIME;
@@ -5,15 +5,103 @@
 #include "../include/linux/mm.h"
 #include "../include/asm/system.h"
 
-struct m_inode inode_table[NR_INODE] = {
-    {
-        0,
-    },
-};
+/*
+ * The in-core inodes live in inode_table[], sized at boot. Inodes with
+ * an identity (i_dev, i_num) are on a hash chain, so iget() doesn't
+ * have to scan the table. Unused inodes (i_count==0) are on the free
+ * list, least recently used first: they keep their contents, so that
+ * iget() can find them again, until get_empty_inode() reuses them.
+ */
+struct m_inode *inode_table;
+int nr_inode = 0;
+
+#define NR_IHASH 307
+#define _ihashfn(dev, nr) (((unsigned)((dev) ^ (nr))) % NR_IHASH)
+#define ihash(dev, nr) ihash_table[_ihashfn(dev, nr)]
+
+static struct m_inode *ihash_table[NR_IHASH];
+static struct m_inode *free_inodes = NULL;
 
 static void read_inode(struct m_inode *inode);
 static void write_inode(struct m_inode *inode);
 
+static void remove_from_free(struct m_inode *inode)
+{
+    if (inode->i_next_free == inode)
+        free_inodes = NULL;
+    else
+    {
+        inode->i_prev_free->i_next_free = inode->i_next_free;
+        inode->i_next_free->i_prev_free = inode->i_prev_free;
+        if (free_inodes == inode)
+            free_inodes = inode->i_next_free;
+    }
+    inode->i_next_free = inode->i_prev_free = NULL;
+}
+
+/*
+ * put_free() puts an inode that just got unused on the free list: at
+ * the end if it has an identity worth keeping, else in front, so that
+ * it's reused first.
+ */
+static void put_free(struct m_inode *inode)
+{
+    if (!free_inodes)
+    {
+        free_inodes = inode->i_next_free = inode->i_prev_free = inode;
+        return;
+    }
+    inode->i_next_free = free_inodes;
+    inode->i_prev_free = free_inodes->i_prev_free;
+    free_inodes->i_prev_free->i_next_free = inode;
+    free_inodes->i_prev_free = inode;
+    if (!inode->i_dev)
+        free_inodes = inode;
+}
+
+static void remove_inode_hash(struct m_inode *inode)
+{
+    if (!inode->i_dev)
+        return;
+    if (inode->i_hash_next)
+        inode->i_hash_next->i_hash_prev = inode->i_hash_prev;
+    if (inode->i_hash_prev)
+        inode->i_hash_prev->i_hash_next = inode->i_hash_next;
+    else if (ihash(inode->i_dev, inode->i_num) == inode)
+        ihash(inode->i_dev, inode->i_num) = inode->i_hash_next;
+    inode->i_hash_next = inode->i_hash_prev = NULL;
+}
+
+/* called when i_dev and i_num have been filled in */
+void insert_inode_hash(struct m_inode *inode)
+{
+    inode->i_hash_prev = NULL;
+    if ((inode->i_hash_next = ihash(inode->i_dev, inode->i_num)))
+        inode->i_hash_next->i_hash_prev = inode;
+    ihash(inode->i_dev, inode->i_num) = inode;
+}
+
+static struct m_inode *find_inode(int dev, int nr)
+{
+    struct m_inode *inode;
+
+    for (inode = ihash(dev, nr); inode; inode = inode->i_hash_next)
+        if (inode->i_dev == dev && inode->i_num == nr)
+            return inode;
+    return NULL;
+}
+
+/*
+ * clear_inode() wipes an inode that is being freed (i_count 1) or is a
+ * pipe, and puts it back on the free list.
+ */
+void clear_inode(struct m_inode *inode)
+{
+    remove_inode_hash(inode);
+    memset(inode, 0, sizeof(*inode));
+    put_free(inode);
+}
+
 static inline void wait_on_inode(struct m_inode *inode)
 {
     cli();
@@ -51,10 +139,48 @@ void sync_inodes(void)
     }
 }
 
+/*
+ * Allocate a zone for 'inode', right after the one it got last if that
+ * is free, so that files written in order end up contiguous.
+ */
+static int inode_new_block(struct m_inode *inode)
+{
+    int block;
+
+    if ((block = new_block(inode->i_dev, inode->i_goal)))
+        inode->i_goal = block + 1;
+    return block;
+}
+
+/*
+ * The bmap() cache: _bmap() remembers the run of contiguous zones that
+ * follows the block it found in an indirect block, and the last second
+ * level block of the double indirect tree. Sequential reads then go to
+ * the indirect blocks once per run, not once per block. Anything that
+ * changes the block map must call bmap_invalidate().
+ */
+void bmap_invalidate(struct m_inode *inode)
+{
+    inode->i_run_len = 0;
+    inode->i_ind_zone = 0;
+}
+
+static void bmap_remember(struct m_inode *inode, int block,
+                          unsigned short *map, int nr)
+{
+    int n;
+
+    for (n = 1; nr + n < 512 && map[nr + n] == map[nr] + n; n++)
+        /* nothing */;
+    inode->i_run_start = block;
+    inode->i_run_zone = map[nr];
+    inode->i_run_len = n;
+}
+
 static int _bmap(struct m_inode *inode, int block, int create)
 {
     struct buffer_head *bh;
-    int i;
+    int i, lblock = block;
 
     if (block < 0)
         panic("_bmap: block<0");
@@ -63,18 +189,21 @@ static int _bmap(struct m_inode *inode, int block, int create)
     if (block < 7)
     {
         if (create && !inode->i_zone[block])
-            if (inode->i_zone[block] = new_block(inode->i_dev))
+            if (inode->i_zone[block] = inode_new_block(inode))
             {
                 inode->i_ctime = CURRENT_TIME;
                 inode->i_dirt = 1;
             }
         return inode->i_zone[block];
     }
+    if (inode->i_run_len && block >= inode->i_run_start &&
+        block - inode->i_run_start < inode->i_run_len)
+        return inode->i_run_zone + (block - inode->i_run_start);
     block -= 7;
     if (block < 512)
     {
         if (create && !inode->i_zone[7])
-            if (inode->i_zone[7] = new_block(inode->i_dev))
+            if (inode->i_zone[7] = inode_new_block(inode))
             {
                 inode->i_dirt = 1;
                 inode->i_ctime = CURRENT_TIME;
@@ -85,44 +214,55 @@ static int _bmap(struct m_inode *inode, int block, int create)
             return 0;
         i = ((unsigned short *)(bh->b_data))[block];
         if (create && !i)
-            if (i = new_block(inode->i_dev))
+            if (i = inode_new_block(inode))
             {
                 ((unsigned short *)(bh->b_data))[block] = i;
-                bh->b_dirt = 1;
+                mark_buffer_dirty(bh);
             }
+        if (i)
+            bmap_remember(inode, lblock, (unsigned short *)bh->b_data, block);
         brelse(bh);
         return i;
     }
     block -= 512;
-    if (create && !inode->i_zone[8])
-        if (inode->i_zone[8] = new_block(inode->i_dev))
-        {
-            inode->i_dirt = 1;
-            inode->i_ctime = CURRENT_TIME;
-        }
-    if (!inode->i_zone[8])
-        return 0;
-    if (!(bh = bread(inode->i_dev, inode->i_zone[8])))
-        return 0;
-    i = ((unsigned short *)bh->b_data)[block >> 9];
-    if (create && !i)
-        if (i = new_block(inode->i_dev))
-        {
-            ((unsigned short *)(bh->b_data))[block >> 9] = i;
-            bh->b_dirt = 1;
-        }
-    brelse(bh);
-    if (!i)
-        return 0;
+    if (inode->i_ind_zone && inode->i_ind_nr == (block >> 9))
+        i = inode->i_ind_zone;
+    else
+    {
+        if (create && !inode->i_zone[8])
+            if (inode->i_zone[8] = inode_new_block(inode))
+            {
+                inode->i_dirt = 1;
+                inode->i_ctime = CURRENT_TIME;
+            }
+        if (!inode->i_zone[8])
+            return 0;
+        if (!(bh = bread(inode->i_dev, inode->i_zone[8])))
+            return 0;
+        i = ((unsigned short *)bh->b_data)[block >> 9];
+        if (create && !i)
+            if (i = inode_new_block(inode))
+            {
+                ((unsigned short *)(bh->b_data))[block >> 9] = i;
+                mark_buffer_dirty(bh);
+            }
+        brelse(bh);
+        if (!i)
+            return 0;
+        inode->i_ind_nr = block >> 9;
+        inode->i_ind_zone = i;
+    }
     if (!(bh = bread(inode->i_dev, i)))
         return 0;
     i = ((unsigned short *)bh->b_data)[block & 511];
     if (create && !i)
-        if (i = new_block(inode->i_dev))
+        if (i = inode_new_block(inode))
         {
             ((unsigned short *)(bh->b_data))[block & 511] = i;
-            bh->b_dirt = 1;
+            mark_buffer_dirty(bh);
         }
+    if (i)
+        bmap_remember(inode, lblock, (unsigned short *)bh->b_data, block & 511);
     brelse(bh);
     return i;
 }
@@ -132,8 +272,17 @@ int bmap(struct m_inode *inode, int block)
     return _bmap(inode, block, 0);
 }
 
+/*
+ * Only a block that isn't mapped yet changes the map, so that is when
+ * the bmap() cache has to go.
+ */
 int create_block(struct m_inode *inode, int block)
 {
+    int i;
+
+    if ((i = _bmap(inode, block, 0)))
+        return i;
+    bmap_invalidate(inode);
     return _bmap(inode, block, 1);
 }
 
@@ -154,11 +303,13 @@ void iput(struct m_inode *inode)
         inode->i_count = 0;
         inode->i_dirt = 0;
         inode->i_pipe = 0;
+        put_free(inode);
         return;
     }
     if (!inode->i_dev || inode->i_count > 1)
     {
-        inode->i_count--;
+        if (!--inode->i_count)
+            put_free(inode);
         return;
     }
 repeat:
@@ -174,40 +325,26 @@ repeat:
         wait_on_inode(inode);
         goto repeat;
     }
-    inode->i_count--;
+    /* somebody may have done an iget() while we slept */
+    if (--inode->i_count)
+        return;
+    put_free(inode);
     return;
 }
 
-static volatile int last_allocated_inode = 0;
-
+/*
+ * get_empty_inode() takes the least recently used inode off the free
+ * list, writing it out first if it's dirty. As that sleeps, we have to
+ * check that nobody got it in the meantime.
+ */
 struct m_inode *get_empty_inode(void)
 {
     struct m_inode *inode;
-    int inr;
 
     while (1)
     {
-        inode = NULL;
-        inr = last_allocated_inode;
-        do
-        {
-            if (!inode_table[inr].i_count)
-            {
-                inode = inr + inode_table;
-                break;
-            }
-            inr++;
-            if (inr >= NR_INODE)
-                inr = 0;
-        } while (inr != last_allocated_inode);
-        if (!inode)
-        {
-            for (inr = 0; inr < NR_INODE; inr++)
-                printk("%04x: %6d\t", inode_table[inr].i_dev,
-                       inode_table[inr].i_num);
+        if (!(inode = free_inodes))
             panic("No free inodes in mem");
-        }
-        last_allocated_inode = inr;
         wait_on_inode(inode);
         while (inode->i_dirt)
         {
@@ -216,7 +353,12 @@ struct m_inode *get_empty_inode(void)
         }
         if (!inode->i_count)
             break;
+        /* in use: don't let it block the head of the list */
+        if (inode->i_next_free)
+            remove_from_free(inode);
     }
+    remove_from_free(inode);
+    remove_inode_hash(inode);
     memset(inode, 0, sizeof(*inode));
     inode->i_count = 1;
     return inode;
@@ -228,9 +370,10 @@ struct m_inode *get_pipe_inode(void)
 
     if (!(inode = get_empty_inode()))
         return NULL;
-    if (!(inode->i_size = get_free_page()))
+    if (!(inode->i_size = get_free_page_nozero()))
     {
         inode->i_count = 0;
+        put_free(inode);
         return NULL;
     }
     inode->i_count = 2; /* sum of readers/writers */
@@ -241,39 +384,55 @@ struct m_inode *get_pipe_inode(void)
 
 struct m_inode *iget(int dev, int nr)
 {
-    struct m_inode *inode, *empty;
+    struct m_inode *inode, *empty = NULL;
 
     if (!dev)
         panic("iget with dev==0");
-    empty = get_empty_inode();
-    inode = inode_table;
-    while (inode < NR_INODE + inode_table)
+repeat:
+    if ((inode = find_inode(dev, nr)))
     {
-        if (inode->i_dev != dev || inode->i_num != nr)
-        {
-            inode++;
-            continue;
-        }
         wait_on_inode(inode);
         if (inode->i_dev != dev || inode->i_num != nr)
-        {
-            inode = inode_table;
-            continue;
-        }
-        inode->i_count++;
+            goto repeat;
+        if (!inode->i_count++)
+            remove_from_free(inode);
         if (empty)
             iput(empty);
         return inode;
     }
+    /* get_empty_inode() may sleep, so look again once we have one */
     if (!empty)
-        return (NULL);
+    {
+        if (!(empty = get_empty_inode()))
+            return (NULL);
+        goto repeat;
+    }
     inode = empty;
     inode->i_dev = dev;
     inode->i_num = nr;
+    insert_inode_hash(inode);
     read_inode(inode);
     return inode;
 }
 
+/*
+ * inode_init() sets up the inode table at 'mem_start', one in-core inode
+ * per 16kB of memory but at least 32, and returns the memory it used.
+ */
+long inode_init(long mem_start, long mem_end)
+{
+    int i;
+
+    nr_inode = mem_end >> 14;
+    if (nr_inode < 32)
+        nr_inode = 32;
+    inode_table = (struct m_inode *)mem_start;
+    memset(inode_table, 0, nr_inode * sizeof(struct m_inode));
+    for (i = 0; i < nr_inode; i++)
+        put_free(inode_table + i);
+    return (nr_inode * sizeof(struct m_inode) + 4095) & ~4095;
+}
+
 static void read_inode(struct m_inode *inode)
 {
     struct super_block *sb;
@@ -308,7 +467,7 @@ static void write_inode(struct m_inode *inode)
     ((struct d_inode *)bh->b_data)
         [(inode->i_num - 1) % INODES_PER_BLOCK] =
             *(struct d_inode *)inode;
-    bh->b_dirt = 1;
+    mark_buffer_dirty(bh);
     inode->i_dirt = 0;
     brelse(bh);
     unlock_inode(inode);
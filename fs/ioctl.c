@@ -11,6 +11,7 @@
 #include "../include/linux/sched.h"
 
 extern int tty_ioctl(int dev, int cmd, int arg);
+extern int blk_ioctl(int dev, int cmd, int arg);
 
 typedef int (*ioctl_ptr)(int dev, int cmd, int arg);
 
@@ -19,8 +20,8 @@ typedef int (*ioctl_ptr)(int dev, int cmd, int arg);
 static ioctl_ptr ioctl_table[] = {
     NULL,      /* nodev */
     NULL,      /* /dev/mem */
-    NULL,      /* /dev/fd */
-    NULL,      /* /dev/hd */
+    blk_ioctl, /* /dev/fd */
+    blk_ioctl, /* /dev/hd */
     tty_ioctl, /* /dev/ttyx */
     tty_ioctl, /* /dev/tty */
     NULL,      /* /dev/lp */
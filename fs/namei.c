@@ -13,6 +13,7 @@
 #include "../include/errno.h"
 #include "../include/const.h"
 #include "../include/sys/stat.h"
+#include "../include/sys/dcstat.h"
 
 #define ACC_MODE(x) ("\004\002\006\377"[(x) & O_ACCMODE])
 
@@ -73,6 +74,175 @@ static int match(int len, const char *name, struct dir_entry *de)
     return same;
 }
 
+/*
+ * The name cache remembers what find_entry() found: the inode number
+ * of a name in a directory, keyed by (device, directory inode, name).
+ * A 0 inode number is a negative entry, the name is not there. Entries
+ * are on a hash chain and on an lru ring, oldest first, which is where
+ * a new entry is taken from.
+ *
+ * Every change to a directory forgets the names involved, and bumps
+ * dc_generation so that a lookup that slept in find_entry() doesn't
+ * cache what it found before the change.
+ */
+#define NR_DCACHE 128
+#define NR_DHASH 61
+
+struct dcache_entry
+{
+    unsigned short dc_dev; /* 0 if unused */
+    unsigned short dc_dir;
+    unsigned short dc_ino; /* 0 if the name doesn't exist */
+    char dc_name[NAME_LEN];
+    struct dcache_entry *dc_next, *dc_prev;         /* hash chain */
+    struct dcache_entry *dc_next_lru, *dc_prev_lru; /* lru ring */
+};
+
+static struct dcache_entry dcache[NR_DCACHE];
+static struct dcache_entry *dhash[NR_DHASH];
+static struct dcache_entry *dc_lru = NULL;
+static unsigned long dc_generation = 0;
+static struct dcstat dc_stat;
+
+static int dc_hashfn(int dev, int dir, const char *name)
+{
+    unsigned long h = dev ^ dir;
+    int i;
+
+    for (i = 0; i < NAME_LEN && name[i]; i++)
+        h = (h << 3) ^ (h >> 28) ^ name[i];
+    return h % NR_DHASH;
+}
+
+static void dc_init(void)
+{
+    int i;
+
+    for (i = 0; i < NR_DCACHE; i++)
+    {
+        dcache[i].dc_next_lru = dcache + (i + 1) % NR_DCACHE;
+        dcache[i].dc_prev_lru = dcache + (i + NR_DCACHE - 1) % NR_DCACHE;
+    }
+    dc_lru = dcache;
+}
+
+static struct dcache_entry *dc_find(int dev, int dir, const char *name)
+{
+    struct dcache_entry *dc;
+
+    for (dc = dhash[dc_hashfn(dev, dir, name)]; dc; dc = dc->dc_next)
+        if (dc->dc_dev == dev && dc->dc_dir == dir &&
+            !strncmp(dc->dc_name, name, NAME_LEN))
+            return dc;
+    return NULL;
+}
+
+static void dc_unhash(struct dcache_entry *dc)
+{
+    if (!dc->dc_dev)
+        return;
+    if (dc->dc_next)
+        dc->dc_next->dc_prev = dc->dc_prev;
+    if (dc->dc_prev)
+        dc->dc_prev->dc_next = dc->dc_next;
+    else
+        dhash[dc_hashfn(dc->dc_dev, dc->dc_dir, dc->dc_name)] = dc->dc_next;
+    dc->dc_next = dc->dc_prev = NULL;
+    dc->dc_dev = 0;
+}
+
+/* make 'dc' the newest entry of the lru ring */
+static void dc_touch(struct dcache_entry *dc)
+{
+    if (dc == dc_lru)
+    {
+        dc_lru = dc->dc_next_lru;
+        return;
+    }
+    dc->dc_prev_lru->dc_next_lru = dc->dc_next_lru;
+    dc->dc_next_lru->dc_prev_lru = dc->dc_prev_lru;
+    dc->dc_next_lru = dc_lru;
+    dc->dc_prev_lru = dc_lru->dc_prev_lru;
+    dc_lru->dc_prev_lru->dc_next_lru = dc;
+    dc_lru->dc_prev_lru = dc;
+}
+
+static void dc_add(int dev, int dir, const char *name, int ino)
+{
+    struct dcache_entry *dc = dc_lru;
+    int h;
+
+    dc_unhash(dc);
+    dc->dc_dev = dev;
+    dc->dc_dir = dir;
+    dc->dc_ino = ino;
+    strncpy(dc->dc_name, name, NAME_LEN);
+    h = dc_hashfn(dev, dir, name);
+    if ((dc->dc_next = dhash[h]))
+        dc->dc_next->dc_prev = dc;
+    dc->dc_prev = NULL;
+    dhash[h] = dc;
+    dc_touch(dc);
+}
+
+/* fetch a name from user space, padded with 0 the way dir entries are */
+static void dc_getname(char *kname, const char *name, int namelen)
+{
+    int i;
+
+    for (i = 0; i < NAME_LEN; i++)
+        kname[i] = (i < namelen) ? get_fs_byte(name + i) : 0;
+}
+
+/* forget 'name' in 'dir', it's about to change */
+static void dc_forget(struct m_inode *dir, const char *name, int namelen)
+{
+    char kname[NAME_LEN];
+    struct dcache_entry *dc;
+
+    dc_generation++;
+    if (!dc_lru)
+        return;
+    dc_getname(kname, name, namelen > NAME_LEN ? NAME_LEN : namelen);
+    if (!(dc = dc_find(dir->i_dev, dir->i_num, kname)))
+        return;
+    dc_unhash(dc);
+    dc_touch(dc);
+    dc_lru = dc; /* reuse it first */
+    dc_stat.dc_forgets++;
+}
+
+/* forget all names on 'dev', or only those in directory 'dir' if set */
+static void dc_purge(int dev, int dir)
+{
+    struct dcache_entry *dc;
+
+    dc_generation++;
+    for (dc = dcache; dc < dcache + NR_DCACHE; dc++)
+        if (dc->dc_dev == dev && (!dir || dc->dc_dir == dir))
+        {
+            dc_unhash(dc);
+            dc_stat.dc_forgets++;
+        }
+}
+
+/* called by put_super(), the names on 'dev' are no good any more */
+void invalidate_dcache(int dev)
+{
+    if (dev)
+        dc_purge(dev, 0);
+}
+
+int sys_dcstat(struct dcstat *buf)
+{
+    int i;
+
+    verify_area(buf, sizeof(struct dcstat));
+    for (i = 0; i < sizeof(struct dcstat); i++)
+        put_fs_byte(((char *)&dc_stat)[i], i + (char *)buf);
+    return 0;
+}
+
 /*
  *      find_entry()
  *
@@ -155,6 +325,56 @@ static struct buffer_head *find_entry(struct m_inode **dir,
     return NULL;
 }
 
+/*
+ *      lookup()
+ *
+ * returns the inode number of 'name' in '*dir', or 0 if there is no
+ * such entry, going through the name cache. '..' is always left to
+ * find_entry(), as it may exchange '*dir' for a mounted-on directory.
+ */
+static int lookup(struct m_inode **dir, const char *name, int namelen)
+{
+    char kname[NAME_LEN];
+    struct buffer_head *bh;
+    struct dir_entry *de;
+    struct dcache_entry *dc;
+    unsigned long gen;
+    int inr = 0;
+
+    if (!namelen || namelen > NAME_LEN ||
+        (namelen == 2 && get_fs_byte(name) == '.' && get_fs_byte(name + 1) == '.'))
+    {
+        if ((bh = find_entry(dir, name, namelen, &de)))
+        {
+            inr = de->inode;
+            brelse(bh);
+        }
+        return inr;
+    }
+    if (!dc_lru)
+        dc_init();
+    dc_getname(kname, name, namelen);
+    if ((dc = dc_find((*dir)->i_dev, (*dir)->i_num, kname)))
+    {
+        dc_touch(dc);
+        if (dc->dc_ino)
+            dc_stat.dc_hits++;
+        else
+            dc_stat.dc_neg_hits++;
+        return dc->dc_ino;
+    }
+    dc_stat.dc_misses++;
+    gen = dc_generation;
+    if ((bh = find_entry(dir, name, namelen, &de)))
+    {
+        inr = de->inode;
+        brelse(bh);
+    }
+    if (gen == dc_generation)
+        dc_add((*dir)->i_dev, (*dir)->i_num, kname, inr);
+    return inr;
+}
+
 /*
  *      add_entry()
  *
@@ -213,10 +433,11 @@ static struct buffer_head *add_entry(struct m_inode *dir,
         }
         if (!de->inode)
         {
+            dc_forget(dir, name, namelen);
             dir->i_mtime = CURRENT_TIME;
             for (i = 0; i < NAME_LEN; i++)
                 de->name[i] = (i < namelen) ? get_fs_byte(name + i) : 0;
-            bh->b_dirt = 1;
+            mark_buffer_dirty(bh);
             *res_dir = de;
             return bh;
         }
@@ -238,9 +459,7 @@ static struct m_inode *get_dir(const char *pathname)
     char c;
     const char *thisname;
     struct m_inode *inode;
-    struct buffer_head *bh;
     int namelen, inr, idev;
-    struct dir_entry *de;
 
     if (!current->root || !current->root->i_count)
         panic("No root inode");
@@ -268,14 +487,12 @@ static struct m_inode *get_dir(const char *pathname)
             /* nothing */;
         if (!c)
             return inode;
-        if (!(bh = find_entry(&inode, thisname, namelen, &de)))
+        if (!(inr = lookup(&inode, thisname, namelen)))
         {
             iput(inode);
             return NULL;
         }
-        inr = de->inode;
         idev = inode->i_dev;
-        brelse(bh);
         iput(inode);
         if (!(inode = iget(idev, inr)))
             return NULL;
@@ -318,22 +535,17 @@ struct m_inode *namei(const char *pathname)
     const char *basename;
     int inr, dev, namelen;
     struct m_inode *dir;
-    struct buffer_head *bh;
-    struct dir_entry *de;
 
     if (!(dir = dir_namei(pathname, &namelen, &basename)))
         return NULL;
     if (!namelen) /* special case: '/usr/' etc */
         return dir;
-    bh = find_entry(&dir, basename, namelen, &de);
-    if (!bh)
+    if (!(inr = lookup(&dir, basename, namelen)))
     {
         iput(dir);
         return NULL;
     }
-    inr = de->inode;
     dev = dir->i_dev;
-    brelse(bh);
     iput(dir);
     dir = iget(dev, inr);
     if (dir)
@@ -374,8 +586,7 @@ int open_namei(const char *pathname, int flag, int mode,
         iput(dir);
         return -EISDIR;
     }
-    bh = find_entry(&dir, basename, namelen, &de);
-    if (!bh)
+    if (!(inr = lookup(&dir, basename, namelen)))
     {
         if (!(flag & O_CREAT))
         {
@@ -405,15 +616,13 @@ int open_namei(const char *pathname, int flag, int mode,
             return -ENOSPC;
         }
         de->inode = inode->i_num;
-        bh->b_dirt = 1;
+        mark_buffer_dirty(bh);
         brelse(bh);
         iput(dir);
         *res_inode = inode;
         return 0;
     }
-    inr = de->inode;
     dev = dir->i_dev;
-    brelse(bh);
     iput(dir);
     if (flag & O_EXCL)
         return -EEXIST;
@@ -481,7 +690,7 @@ int sys_mknod(const char *filename, int mode, int dev)
         return -ENOSPC;
     }
     de->inode = inode->i_num;
-    bh->b_dirt = 1;
+    mark_buffer_dirty(bh);
     iput(dir);
     iput(inode);
     brelse(bh);
@@ -526,7 +735,7 @@ int sys_mkdir(const char *pathname, int mode)
     inode->i_size = 32;
     inode->i_dirt = 1;
     inode->i_mtime = inode->i_atime = CURRENT_TIME;
-    if (!(inode->i_zone[0] = new_block(inode->i_dev)))
+    if (!(inode->i_zone[0] = new_block(inode->i_dev, dir->i_zone[0])))
     {
         iput(dir);
         inode->i_nlinks--;
@@ -549,7 +758,7 @@ int sys_mkdir(const char *pathname, int mode)
     de->inode = dir->i_num;
     strcpy(de->name, "..");
     inode->i_nlinks = 2;
-    dir_block->b_dirt = 1;
+    mark_buffer_dirty(dir_block);
     brelse(dir_block);
     inode->i_mode = I_DIRECTORY | (mode & 0777 & ~current->umask);
     inode->i_dirt = 1;
@@ -563,7 +772,7 @@ int sys_mkdir(const char *pathname, int mode)
         return -ENOSPC;
     }
     de->inode = inode->i_num;
-    bh->b_dirt = 1;
+    mark_buffer_dirty(bh);
     dir->i_nlinks++;
     dir->i_dirt = 1;
     iput(dir);
@@ -683,8 +892,10 @@ int sys_rmdir(const char *name)
     }
     if (inode->i_nlinks != 2)
         printk("empty directory has nlink!=2 (%d)", inode->i_nlinks);
+    dc_forget(dir, basename, namelen);
+    dc_purge(inode->i_dev, inode->i_num);
     de->inode = 0;
-    bh->b_dirt = 1;
+    mark_buffer_dirty(bh);
     brelse(bh);
     inode->i_nlinks = 0;
     inode->i_dirt = 1;
@@ -757,8 +968,9 @@ int sys_unlink(const char *name)
                inode->i_dev, inode->i_num, inode->i_nlinks);
         inode->i_nlinks = 1;
     }
+    dc_forget(dir, basename, namelen);
     de->inode = 0;
-    bh->b_dirt = 1;
+    mark_buffer_dirty(bh);
     brelse(bh);
     inode->i_nlinks--;
     inode->i_dirt = 1;
@@ -824,7 +1036,7 @@ int sys_link(const char *oldname, const char *newname)
         return -ENOSPC;
     }
     de->inode = oldinode->i_num;
-    bh->b_dirt = 1;
+    mark_buffer_dirty(bh);
     brelse(bh);
     iput(dir);
     oldinode->i_nlinks++;
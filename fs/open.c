@@ -193,6 +193,8 @@ int sys_open(const char *filename, int flag, int mode)
     f->f_count = 1;
     f->f_inode = inode;
     f->f_pos = 0;
+    f->f_ra_next = f->f_ra_end = 0;
+    f->f_ra_win = 0;
     return (fd);
 }
 
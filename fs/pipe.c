@@ -34,8 +34,8 @@ int read_pipe(struct m_inode *inode, char *buf, int count)
         size = PIPE_TAIL(*inode);
         PIPE_TAIL(*inode) += chars;
         PIPE_TAIL(*inode) &= (PAGE_SIZE - 1);
-        while (chars-- > 0)
-            put_fs_byte(((char *)inode->i_size)[size++], buf++);
+        copy_to_user(buf, (char *)inode->i_size + size, chars);
+        buf += chars;
     }
     wake_up(&inode->i_wait);
     return read;
@@ -67,8 +67,8 @@ int write_pipe(struct m_inode *inode, char *buf, int count)
         size = PIPE_HEAD(*inode);
         PIPE_HEAD(*inode) += chars;
         PIPE_HEAD(*inode) &= (PAGE_SIZE - 1);
-        while (chars-- > 0)
-            ((char *)inode->i_size)[size++] = get_fs_byte(buf++);
+        copy_from_user((char *)inode->i_size + size, buf, chars);
+        buf += chars;
     }
     wake_up(&inode->i_wait);
     return written;
@@ -114,6 +114,7 @@ int sys_pipe(unsigned long *fildes)
     f[0]->f_pos = f[1]->f_pos = 0;
     f[0]->f_mode = 1; /* read */
     f[1]->f_mode = 2; /* write */
+    verify_area(fildes, 8);
     put_fs_long(fd[0], 0 + fildes);
     put_fs_long(fd[1], 1 + fildes);
     return 0;
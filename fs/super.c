@@ -96,6 +96,7 @@ void put_super(int dev)
         return;
     }
     lock_super(sb);
+    invalidate_dcache(dev);
     sb->s_dev = 0;
     for (i = 0; i < I_MAP_SLOTS; i++)
         brelse(sb->s_imap[i]);
@@ -172,6 +173,11 @@ static struct super_block *read_super(int dev)
     }
     s->s_imap[0]->b_data[0] |= 1;
     s->s_zmap[0]->b_data[0] |= 1;
+    s->s_zgoal = 0;
+    s->s_zfree = 0;
+    for (i = s->s_nzones - s->s_firstdatazone; i > 0; i--)
+        if (!set_bit(i & 8191, s->s_zmap[i >> 13]->b_data))
+            s->s_zfree++;
     free_super(s);
     return s;
 }
@@ -290,12 +296,7 @@ void mount_root(void)
     p->s_isup = p->s_imount = mi; // 根设备的super_block块的上级节点和挂载节点设置为根inode
     current->pwd = mi;            // 将当前进程的工作目录设置为根inode
     current->root = mi;           // 将当前进程的根目录设置为根inode
-    free = 0;
-    i = p->s_nzones;
-    while (--i >= 0)
-        if (!set_bit(i & 8191, p->s_zmap[i >> 13]->b_data))
-            free++;
-    printk("%d/%d free blocks\n\r", free, p->s_nzones);
+    printk("%d/%d free blocks\n\r", p->s_zfree, p->s_nzones);
     free = 0;
     i = p->s_ninodes + 1;
     while (--i >= 0)
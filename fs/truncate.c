@@ -52,6 +52,7 @@ void truncate(struct m_inode *inode)
 
     if (!(S_ISREG(inode->i_mode) || S_ISDIR(inode->i_mode)))
         return;
+    bmap_invalidate(inode);
     for (i = 0; i < 7; i++)
         if (inode->i_zone[i])
         {
@@ -23,3 +23,11 @@ __asm__ volatile ("inb %%dx,%%al\n" \
             _v; \
             })
 
+#define outl(value,port) \
+__asm__ ("outl %%eax,%%dx"::"a" (value),"d" (port))
+
+#define inl(port) ({ \
+unsigned long _v; \
+__asm__ volatile ("inl %%dx,%%eax":"=a" (_v):"d" (port)); \
+_v; \
+})
@@ -37,6 +37,91 @@ extern inline void put_fs_long(unsigned long val,unsigned long * addr)
 __asm__ ("movl %0,%%fs:%1"::"r" (val),"m" (*addr));
 }
 
+/*
+ * Bulk copies between kernel space and the user space in %fs. The
+ * destination is brought to a longword boundary with a few movsb, the
+ * bulk goes with rep movsl and the tail with movsb again. clear_user()
+ * zeroes user memory the same way with stos. copy_to_user() and
+ * clear_user() do verify_area() themselves: the 386 ignores write
+ * protection in kernel mode, so copy-on-write pages have to be unshared
+ * before we write.
+ */
+extern void verify_area(void *addr, int count);
+
+extern inline void copy_to_user(char *to, const char *from, int n)
+{
+    int head = (-(long)to) & 3;
+
+    if (n <= 0)
+        return;
+    verify_area(to, n);
+    if (head > n)
+        head = n;
+    __asm__("push %%es\n\t"
+            "push %%fs\n\t"
+            "pop %%es\n\t"
+            "cld\n\t"
+            "rep ; movsb\n\t"
+            "movl %%edx,%%ecx\n\t"
+            "shrl $2,%%ecx\n\t"
+            "rep ; movsl\n\t"
+            "movl %%edx,%%ecx\n\t"
+            "andl $3,%%ecx\n\t"
+            "rep ; movsb\n\t"
+            "pop %%es" ::"c"(head),
+            "d"(n - head), "S"(from), "D"(to)
+            : "cx", "si", "di");
+}
+
+extern inline void clear_user(char *to, int n)
+{
+    int head = (-(long)to) & 3;
+
+    if (n <= 0)
+        return;
+    verify_area(to, n);
+    if (head > n)
+        head = n;
+    __asm__("push %%es\n\t"
+            "push %%fs\n\t"
+            "pop %%es\n\t"
+            "cld\n\t"
+            "rep ; stosb\n\t"
+            "movl %%edx,%%ecx\n\t"
+            "shrl $2,%%ecx\n\t"
+            "rep ; stosl\n\t"
+            "movl %%edx,%%ecx\n\t"
+            "andl $3,%%ecx\n\t"
+            "rep ; stosb\n\t"
+            "pop %%es" ::"a"(0),
+            "c"(head), "d"(n - head), "D"(to)
+            : "cx", "di");
+}
+
+extern inline void copy_from_user(char *to, const char *from, int n)
+{
+    int head = (-(long)to) & 3;
+
+    if (n <= 0)
+        return;
+    if (head > n)
+        head = n;
+    __asm__("push %%ds\n\t"
+            "push %%fs\n\t"
+            "pop %%ds\n\t"
+            "cld\n\t"
+            "rep ; movsb\n\t"
+            "movl %%edx,%%ecx\n\t"
+            "shrl $2,%%ecx\n\t"
+            "rep ; movsl\n\t"
+            "movl %%edx,%%ecx\n\t"
+            "andl $3,%%ecx\n\t"
+            "rep ; movsb\n\t"
+            "pop %%ds" ::"c"(head),
+            "d"(n - head), "S"(from), "D"(to)
+            : "cx", "si", "di");
+}
+
 /*
 * Someone who knows GNU asm better than I should double check the followig.
 * It seems to work, but I don't know if I'm doing something subtly wrong.
@@ -6,6 +6,13 @@
 * root-device by changing the line ROOT_DEV = XXX in boot/bootsect.s
 */
 
+/*
+ * Define RAMDISK to the size in kB of a ram disk to carve out of memory
+ * at boot. If the boot floppy holds a minix image at block 256, it is
+ * loaded into the ram disk, which then becomes the root device.
+ */
+/* #define RAMDISK 512 */
+
 /* define your keyboard here - US (KBD_US) or Finnish (KBD_FINNISH) */
 #define KBD_US
 /* #define KBD_FINNISH */
@@ -32,6 +32,14 @@ void buffer_init(long buffer_end);
 #define MAJOR(a) (((unsigned)(a)) >> 8)  /* Linux 内核中，设备号由主设备号和次设备号组成，用于唯一标识设备，主设备号区分设备的类别，次设备号区分同类下的实例 */
 #define MINOR(a) ((a) & 0xff)
 
+#define NR_BLK_DEV 7 /* block majors, see kernel/blk_drv */
+
+/* block device ioctls, see blk_ioctl() */
+#define BLKGETSCHED 0x1201 /* returns the io scheduler of the major */
+#define BLKSETSCHED 0x1202 /* arg is the scheduler to switch to */
+#define IOSCHED_ELEVATOR 0 /* one-way elevator, sorted by sector */
+#define IOSCHED_DEADLINE 1 /* elevator with read/write expiry */
+
 #define NAME_LEN 14
 #define ROOT_INO 1
 
@@ -40,7 +48,7 @@ void buffer_init(long buffer_end);
 #define SUPER_MAGIC 0x137F
 
 #define NR_OPEN 20
-#define NR_INODE 32
+#define NR_INODE nr_inode /* chosen at boot, see inode_init() */
 #define NR_FILE 64
 #define NR_SUPER 8
 #define NR_HASH 307
@@ -73,11 +81,16 @@ struct buffer_head
     unsigned char b_dirt;  /* 0-clean,1-dirty */
     unsigned char b_count; /* users using this block */
     unsigned char b_lock;  /* 0 - ok, 1 -locked */
+    unsigned char b_list;  /* lru list we are on, NR_LIST if in use */
+    unsigned long b_flushtime; /* jiffies when a dirty buffer is due */
     struct task_struct *b_wait;
     struct buffer_head *b_prev;
     struct buffer_head *b_next;
-    struct buffer_head *b_prev_free;
+    struct buffer_head *b_prev_free; /* lru list, only when b_count==0 */
     struct buffer_head *b_next_free;
+    struct buffer_head *b_prev_dirty; /* per-device dirty list */
+    struct buffer_head *b_next_dirty; /* NULL if not on it */
+    struct buffer_head *b_reqnext;    /* next buffer in the same request */
 };
 
 struct d_inode
@@ -113,6 +126,16 @@ struct m_inode
     unsigned char i_mount;   /* 是否为挂载点 */
     unsigned char i_seek;    /* 文件读写指针的位置 */
     unsigned char i_update;  /* 是否需要更新 */
+    unsigned short i_goal;   /* zone to try first for the next new block */
+    unsigned long i_run_start;  /* bmap() cache: a logical block, */
+    unsigned short i_run_zone;  /* the zone it maps to, */
+    unsigned short i_run_len;   /* and the contiguous run, 0 if none */
+    unsigned short i_ind_nr;    /* double indirect slot of i_ind_zone */
+    unsigned short i_ind_zone;  /* last 2nd level indirect block, or 0 */
+    struct m_inode *i_hash_next; /* (dev,num) hash chain, if i_dev */
+    struct m_inode *i_hash_prev;
+    struct m_inode *i_next_free; /* lru of unused inodes, i_count==0 */
+    struct m_inode *i_prev_free;
 };
 
 struct file
@@ -122,6 +145,9 @@ struct file
     unsigned short f_count;
     struct m_inode *f_inode;
     off_t f_pos;
+    unsigned long f_ra_next; /* block a sequential reader reads next */
+    unsigned long f_ra_end;  /* first block not read ahead yet */
+    unsigned short f_ra_win; /* readahead window, 0 for random access */
 };
 
 struct super_block
@@ -145,6 +171,8 @@ struct super_block
     unsigned char s_lock;
     unsigned char s_rd_only;
     unsigned char s_dirt;
+    unsigned short s_zgoal; /* zmap bit to start looking for free zones */
+    unsigned short s_zfree; /* free zones, counted by read_super() */
 };
 
 struct d_super_block
@@ -165,7 +193,8 @@ struct dir_entry
     char name[NAME_LEN];
 };
 
-extern struct m_inode inode_table[NR_INODE];
+extern struct m_inode *inode_table;
+extern int nr_inode;
 extern struct file file_table[NR_FILE];
 extern struct super_block super_block[NR_SUPER];
 extern struct buffer_head *start_buffer;
@@ -181,6 +210,7 @@ extern void sync_inodes(void);
 extern void wait_on(struct m_inode *inode);
 extern int bmap(struct m_inode *inode, int block);
 extern int create_block(struct m_inode *inode, int block);
+extern void bmap_invalidate(struct m_inode *inode);
 extern struct m_inode *namei(const char *pathname);
 extern int open_namei(const char *pathname, int flag, int mode,
                       struct m_inode **res_inode);
@@ -190,18 +220,29 @@ extern struct m_inode *get_empty_inode(void);
 extern struct m_inode *get_pipe_inode(void);
 extern struct buffer_head *get_hash_table(int dev, int block);
 extern struct buffer_head *getblk(int dev, int block);
+extern struct buffer_head *getblk_overwrite(int dev, int block);
+extern void end_overwrite(struct buffer_head *bh);
 extern void ll_rw_block(int rw, struct buffer_head *bh);
 extern void brelse(struct buffer_head *buf);
+extern void mark_buffer_dirty(struct buffer_head *bh);
 extern struct buffer_head *bread(int dev, int block);
 extern struct buffer_head *breada(int dev, int block, ...);
-extern int new_block(int dev);
+extern void bread_async(int dev, int block);
+extern void bread_page(unsigned long addr, int dev, int b[4]);
+extern int new_block(int dev, int goal);
 extern void free_block(int dev, int block);
 extern struct m_inode *new_inode(int dev);
+extern void insert_inode_hash(struct m_inode *inode);
+extern void clear_inode(struct m_inode *inode);
+extern long inode_init(long mem_start, long mem_end);
 extern void free_inode(struct m_inode *inode);
 extern int sync_dev(int dev);
 extern struct super_block *get_super(int dev);
 extern int ROOT_DEV;
 
 extern void mount_root(void);
+extern void invalidate_dcache(int dev);
+extern long ram_init(long mem_start, int length);
+extern void ram_load(void);
 
 #endif
@@ -40,6 +40,21 @@
 #define WIN_SEEK 0x70
 #define WIN_DIAGNOSE 0x90
 #define WIN_SPECIFY 0x91
+#define WIN_IDENTIFY 0xEC
+#define WIN_READDMA 0xC8
+#define WIN_WRITEDMA 0xCA
+
+/* PCI IDE bus-master registers, offsets from BAR4 (primary channel) */
+#define BM_COMMAND 0x0 /* bit 0 start, bit 3 read (device to memory) */
+#define BM_STATUS 0x2  /* see bits below */
+#define BM_PRDT 0x4    /* physical address of the PRD table */
+
+#define BM_CMD_START 0x01
+#define BM_CMD_READ 0x08
+
+#define BM_STAT_ACTIVE 0x01
+#define BM_STAT_ERR 0x02
+#define BM_STAT_INTR 0x04 /* write 1 to clear, as ERR */
 
 /* Bits for HD_ERROR */
 #define MARK_ERR 0x01 /* Bad address mark ? */
@@ -5,8 +5,11 @@ typedef struct desc_struct {
 	unsigned long a,b;
 } desc_table[256];
 
+#define NR_GDT_ENTRIES 1024 /* must match gdt_descr in head.s */
+
 extern unsigned long pg_dir[1024];
-extern desc_table idt,gdt;  // idt,gdt 是在head.s 中定义的
+extern desc_table idt;  // idt,gdt 是在head.s 中定义的
+extern struct desc_struct gdt[NR_GDT_ENTRIES];
 
 #define GDT_NUL 0
 #define GDT_CODE 1
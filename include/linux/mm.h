@@ -3,8 +3,20 @@
 
 #define PAGE_SIZE 4096
 
+/*
+ * Every page directory identity-maps physical memory below TASK_BASE,
+ * for the kernel. User space (the LDT segments of all tasks but task 0)
+ * starts at TASK_BASE, so that is as much memory as we can use.
+ */
+#define TASK_BASE 0x40000000
+#define MAX_MEMORY TASK_BASE
+
 extern unsigned long get_free_page(void);
+extern unsigned long get_free_page_nozero(void);
+extern void zero_free_pages(void);
 extern unsigned long put_page(unsigned long page,unsigned long address);
 extern void free_page(unsigned long addr);
+extern long paging_init(long start_mem, long end_mem);
+extern unsigned long get_page_dir(void);
 
 #endif
\ No newline at end of file
@@ -1,7 +1,14 @@
 #ifndef _SCHED_H
 #define _SCHED_H
 
-#define NR_TASKS 64
+/*
+ * NR_TASKS is limited by the gdt in head.s, which has room for two
+ * descriptors per task, and by the page counts in mm/memory.c.
+ * TASK_SIZE is the size of a process' address space; it starts at
+ * TASK_BASE (linux/mm.h) and must stay below 4GB.
+ */
+#define NR_TASKS 128
+#define TASK_SIZE 0x4000000
 #define HZ 100
 
 #define FIRST_TASK task[0]
@@ -12,6 +19,10 @@
 #include "../include/linux/mm.h"
 #include "../include/signal.h"
 
+#if (TASK_SIZE > 0xffffffff - TASK_BASE + 1)
+#error "TASK_SIZE doesn't fit above TASK_BASE"
+#endif
+
 #if (NR_OPEN > 32)
 #error "Currently the close-on-exec-flags are in one word, max 32 files/proc"
 #endif
@@ -26,8 +37,11 @@
 #define NULL ((void *)0)
 #endif
 
-extern int copy_page_tables(unsigned long from, unsigned long to, long size);
-extern int free_page_tables(unsigned long from, long size);
+extern int copy_page_tables(unsigned long from_pgd, unsigned long to_pgd,
+                            unsigned long from, unsigned long to, long size);
+extern int free_page_tables(unsigned long pgd, unsigned long from, long size);
+
+extern void end_vfork(void);
 
 extern void sched_init(void);
 extern void schedule(void);
@@ -90,6 +104,8 @@ struct task_struct
         int exit_code;
         unsigned long end_code, end_data, brk, start_stack;
         long pid, father, pgrp, session, leader;
+        long vfork;                     /* still running in the parent's memory */
+        struct task_struct *vfork_wait; /* the parent, waiting for that to end */
         unsigned short uid, euid, suid;
         unsigned short gid, egid, sgid;
         long alarm;
@@ -100,6 +116,7 @@ struct task_struct
         unsigned short umask;
         struct m_inode *pwd;
         struct m_inode *root;
+        struct m_inode *executable;
         unsigned long close_on_exec;
         struct file *filp[NR_OPEN];
         /* ldt for this task 0 - zero 1 - cs 2 - ds&ss */
@@ -118,7 +135,7 @@ struct task_struct
                     /* signals */ 0, {                                                                                                                                                                                \
                                          {},                                                                                                                                                                          \
                                      },                                                                                                                                                                               \
-                    0, /* ec,brk... */ 0, 0, 0, 0, 0, /* pid etc.. */ 0, -1, 0, 0, 0, /* uid etc */ 0, 0, 0, 0, 0, 0, /* alarm */ 0, 0, 0, 0, 0, 0, /* math */ 0, /* fs info */ -1, 0022, NULL, NULL, 0, /* filp */ { \
+                    0, /* ec,brk... */ 0, 0, 0, 0, 0, /* pid etc.. */ 0, -1, 0, 0, 0, /* vfork */ 0, NULL, /* uid etc */ 0, 0, 0, 0, 0, 0, /* alarm */ 0, 0, 0, 0, 0, 0, /* math */ 0, /* fs info */ -1, 0022, NULL, NULL, NULL, 0, /* filp */ { \
                                                                                                                                                                                                           NULL,       \
                                                                                                                                                                                                       },              \
                     {                                                                                                                                                                                                 \
@@ -150,6 +167,15 @@ extern void wake_up(struct task_struct **p);
 #define FIRST_LDT_ENTRY (FIRST_TSS_ENTRY + 1)
 #define _TSS(n) ((((unsigned long)n) << 4) + (FIRST_TSS_ENTRY << 3))
 #define _LDT(n) ((((unsigned long)n) << 4) + (FIRST_LDT_ENTRY << 3))
+
+#if (NR_TASKS > (NR_GDT_ENTRIES - FIRST_TSS_ENTRY) / 2)
+#error "NR_TASKS doesn't fit in the gdt, see head.s"
+#endif
+
+/* every task can hold a reference to a page or page table: mem_map is bytes */
+#if (NR_TASKS > 255)
+#error "NR_TASKS too big for the mem_map counts in mm/memory.c"
+#endif
 #define ltr(n) __asm__("ltr %%ax" ::"a"(_TSS(n)))
 #define lldt(n) __asm__("lldt %%ax" ::"a"(_LDT(n)))
 #define str(n)                      \
@@ -68,6 +68,9 @@ extern int sys_setsid();
 extern int sys_sigaction();
 extern int sys_sgetmask();
 extern int sys_ssetmask();
+extern int sys_bdflush();
+extern int sys_dcstat();
+extern int sys_vfork();
 
 fn_ptr sys_call_table[] = {sys_setup, sys_exit, sys_fork, sys_read,
                            sys_write, sys_open, sys_close, sys_waitpid, sys_creat, sys_link,
@@ -80,4 +83,5 @@ fn_ptr sys_call_table[] = {sys_setup, sys_exit, sys_fork, sys_read,
                            sys_getgid, sys_signal, sys_geteuid, sys_getegid, sys_acct, sys_phys,
                            sys_lock, sys_ioctl, sys_fcntl, sys_mpx, sys_setpgid, sys_ulimit,
                            sys_uname, sys_umask, sys_chroot, sys_ustat, sys_dup2, sys_getppid,
-                           sys_getpgrp, sys_setsid, sys_sigaction, sys_sgetmask, sys_ssetmask};
\ No newline at end of file
+                           sys_getpgrp, sys_setsid, sys_sigaction, sys_sgetmask, sys_ssetmask,
+                           sys_bdflush, sys_dcstat, sys_vfork};
\ No newline at end of file
@@ -0,0 +1,14 @@
+#ifndef _SYS_DCSTAT_H
+#define _SYS_DCSTAT_H
+
+/* name cache statistics, see fs/namei.c */
+struct dcstat {
+    long dc_hits;     /* lookups answered with an inode number */
+    long dc_neg_hits; /* lookups answered with "no such name" */
+    long dc_misses;   /* lookups that had to search the directory */
+    long dc_forgets;  /* entries dropped because a directory changed */
+};
+
+extern int dcstat(struct dcstat *buf);
+
+#endif
@@ -53,6 +53,7 @@
 #include "sys/stat.h"
 #include "sys/times.h"
 #include "sys/utsname.h"
+#include "sys/dcstat.h"
 #include "utime.h"
 
 #ifdef __LIBRARY__
@@ -125,6 +126,11 @@
 #define __NR_getpgrp 65
 #define __NR_setsid 66
 #define __NR_sigaction 67
+#define __NR_sgetmask 68
+#define __NR_ssetmask 69
+#define __NR_bdflush 70
+#define __NR_dcstat 71
+#define __NR_vfork 72
 
 #define _syscall0(type, name)                         \
         type name(void)                               \
@@ -184,6 +190,7 @@ extern int errno;
 int access(const char *filename, mode_t mode);
 int acct(const char *filename);
 int alarm(int sec);
+int bdflush(int func, long data);
 int brk(void *end_data_segment);
 void *sbrk(ptrdiff_t increment);
 int chdir(const char *filename);
@@ -192,6 +199,7 @@ int chown(const char *filename, uid_t owner, gid_t group);
 int chroot(const char *filename);
 int close(int fildes);
 int creat(const char *filename, mode_t mode);
+int dcstat(struct dcstat *buf);
 int dup(int fildes);
 int execve(const char *filename, char **argv, char **envp);
 int execv(const char *pathname, char **argv);
@@ -203,6 +211,7 @@ volatile void exit(int status);
 volatile void _exit(int status);
 int fcntl(int fildes, int cmd, ...);
 int fork(void);
+int vfork(void);
 int getpid(void);
 int getuid(void);
 int geteuid(void);
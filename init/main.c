@@ -34,10 +34,13 @@ static inline _syscall0(int, fork)  /* 创建一个新进程，新进程是调
 									 * 分配一个新的物理内存页，将修改之后的数据复制到新的内存页中。这样父进程和子进程就各有拥有自己的物理内存页。
 									 * Copy-on-Write是在内核态实现的。
 									 */
+static inline _syscall0(int, vfork)
 static inline _syscall0(int, pause) /* 使调用进程挂起(暂停)直到收到一个信号，这个系统调用通常用于进程间的同步。 */
 static inline _syscall1(int, setup, void *, BIOS) /* 用于设置系统的一些参数，参数是一个void* 类型的指针 */
 static inline _syscall0(int, sync)  /* 用于将文件系统的缓冲区数据写入磁盘，确保数据持久化 */
+static inline _syscall2(int, bdflush, int, func, long, data)
 
+#include "../include/linux/config.h"
 #include "../include/linux/tty.h"
 #include "../include/linux/sched.h"
 #include "../include/linux/head.h"
@@ -69,6 +72,8 @@ extern long startup_time;
  */
 #define EXT_MEM_K (*(unsigned short *)0x90002)
 #define DRIVE_INFO (*(struct drive_info *)0x90080)
+#define E820_MAP ((struct e820entry *)0x90100)
+#define E820_NR (*(unsigned short *)0x901F0)
 #define ORIG_ROOT_DEV (*(unsigned short *)0x901FC)
 
 /*
@@ -118,12 +123,53 @@ static void time_init(void)
 
 static long memory_end = 0;
 static long buffer_memory_end = 0;
+static long main_memory_start = 0;
 
 struct drive_info
 {
 	char dummy[32];
 } drive_info;
 
+/* one entry of the bios memory map, as saved by setup.s */
+struct e820entry
+{
+	unsigned long addr, addr_hi;
+	unsigned long size, size_hi;
+	unsigned long type;
+};
+
+#define E820_RAM 1
+
+/*
+ * Find where the usable memory that starts at 1MB ends, gluing together
+ * ram entries that touch. The map needn't be sorted, hence the loop.
+ */
+static long e820_memory_end(void)
+{
+	struct e820entry *e;
+	unsigned long end = 1 << 20, top;
+	int i, grown;
+
+	do
+	{
+		grown = 0;
+		for (i = 0, e = E820_MAP; i < E820_NR; i++, e++)
+		{
+			if (e->type != E820_RAM || e->addr_hi)
+				continue;
+			top = e->addr + e->size;
+			if (e->size_hi || top < e->addr)
+				top = 0xfffff000;
+			if (e->addr <= end && top > end)
+			{
+				end = top;
+				grown = 1;
+			}
+		}
+	} while (grown && end < MAX_MEMORY);
+	return end;
+}
+
 void main(void) /* This really IS void, no error here. */
 {				/* The startup routine assumes (well, ...) this */
 	/*
@@ -132,15 +178,29 @@ void main(void) /* This really IS void, no error here. */
 	 */
 	ROOT_DEV = ORIG_ROOT_DEV;
 	drive_info = DRIVE_INFO;
-	memory_end = (1 << 20) + (EXT_MEM_K << 10);
+	if (E820_NR)
+		memory_end = e820_memory_end();
+	else
+		memory_end = (1 << 20) + (EXT_MEM_K << 10);
 	memory_end &= 0xfffff000;    // memory_end 只有前20位是有效的
-	if (memory_end > 16 * 1024 * 1024)
-		memory_end = 16 * 1024 * 1024;  // memory_end最大是16MB
-	if (memory_end > 6 * 1024 * 1024)
-		buffer_memory_end = 2 * 1024 * 1024;  // buffer_memory_end 最大是2MB
+	if (memory_end > MAX_MEMORY)
+		memory_end = MAX_MEMORY;
+	if (memory_end > 32 * 1024 * 1024)
+		buffer_memory_end = 8 * 1024 * 1024;
+	else if (memory_end > 12 * 1024 * 1024)
+		buffer_memory_end = 4 * 1024 * 1024;
+	else if (memory_end > 6 * 1024 * 1024)
+		buffer_memory_end = 2 * 1024 * 1024;
 	else
 		buffer_memory_end = 1 * 1024 * 1024;
-	mem_init(buffer_memory_end, memory_end);  // 将内存页标记为未使用
+	main_memory_start = buffer_memory_end;
+	/* map all of memory first: only the first 16MB are mapped so far */
+	main_memory_start += paging_init(main_memory_start, memory_end);
+	main_memory_start += inode_init(main_memory_start, memory_end);
+#ifdef RAMDISK
+	main_memory_start += ram_init(main_memory_start, RAMDISK * 1024);
+#endif
+	mem_init(main_memory_start, memory_end);  // 将内存页标记为未使用
 	trap_init();
 	blk_dev_init();
 	chr_dev_init();
@@ -162,6 +222,7 @@ void main(void) /* This really IS void, no error here. */
 	 * as task 0 gets activated at every idle moment (when no other tasks
 	 * can run). For task0 'pause()' just means we go check if some other
 	 * task can run, and if not we return here.
+	 * sys_pause() also uses these idle moments to zero free pages.
 	 * 对于task0任务(即内核初始化任务),pause并不会让任务真正休眠等待信号唤醒,而是
 	 * 在空闲时刻检查是否有其他任务可以运行,如果没有则返回.
 	 */
@@ -188,7 +249,9 @@ void init(void)
 	int i, j;
 
 	setup((void *)&drive_info); // 设置驱动信息
-	if (!fork()) // 创建一个子进程,用于执行下面一行代码
+	if (!fork())
+		_exit(bdflush(0, 0)); /* never returns: this is the buffer writeback daemon */
+	if (!vfork()) // 创建一个子进程,用于执行下面一行代码
 		_exit(execve("/bin/update", NULL, NULL)); //子进程执行execve系统调用,加载并执行/bin/update程序,这是个系统更新操作.
 	(void)open("/dev/tty0", O_RDWR, 0); // 以读写的方式打开控制台设备 /dev/tty0
 	(void)dup(0); // 复制文件描述符0(标准输入)
@@ -197,7 +260,7 @@ void init(void)
 		   NR_BUFFERS * BLOCK_SIZE);
 	printf("Free mem: %d bytes\n\r", memory_end - buffer_memory_end);
 	printf(" Ok.\n\r");
-	if ((i = fork()) < 0)
+	if ((i = vfork()) < 0)
 		printf("Fork failed in init\r\n");
 	else if (!i) // 子进程
 	{
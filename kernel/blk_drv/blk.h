@@ -1,7 +1,6 @@
 #ifndef _BLK_H
 #define _BLK_H
 
-#define NR_BLK_DEV 7
 #define NR_REQUEST 64
 
 /*
@@ -20,6 +19,10 @@ struct request
     char *buffer;            /* 指向存储请求数据的缓冲区 */
     struct task_struct *waiting; /* 等待处理该请求的进程队列 */
     struct buffer_head *bh;  /* 指向与请求相关的缓冲块头结构体 */
+    struct buffer_head *bhtail; /* last buffer of the bh->b_reqnext chain */
+    unsigned long current_nr_sectors; /* sectors left in 'bh' */
+    unsigned long start_time; /* jiffies when queued, for deadline */
+    struct request *fifo_next, *fifo_prev; /* deadline fifo, by start_time */
     struct request *next;   /* 指向在一个请求结构体,构建请求链表 */
 };
 
@@ -27,10 +30,25 @@ struct request
     ((s1)->dev < (s2)->dev || ((s1)->dev == (s2)->dev && \
                                (s1)->sector < (s2)->sector))
 
+/*
+ * An io scheduler decides the order in which the requests of a major
+ * are served. add_request() puts 'req' somewhere behind the request the
+ * driver is working on, next_request() is called by end_request() and
+ * returns the request to start after 'done'.
+ */
+struct io_sched
+{
+    char *name;
+    void (*add_request)(struct request *head, struct request *req);
+    struct request *(*next_request)(struct request *done);
+};
+
 struct blk_dev_struct
 {
     void (*request_fn)(void);
     struct request *current_request;
+    struct io_sched *sched;
+    struct request *fifo[2]; /* deadline: oldest READ, WRITE request */
 };
 
 extern struct blk_dev_struct blk_dev[NR_BLK_DEV];
@@ -41,9 +59,17 @@ extern struct task_struct *wait_for_request;
 
 /*
  * Add entries as needed. Currently the only block devices
- * supported are hard-disks and floppies.
+ * supported are hard-disks, floppies and the ram disk.
  */
-#if (MAJOR_NR == 2)
+#if (MAJOR_NR == 1)
+/* ram disk */
+#define DEVICE_NAME "ramdisk"
+#define DEVICE_REQUEST do_ram_request
+#define DEVICE_NR(device) ((device) & 7)
+#define DEVICE_ON(device)
+#define DEVICE_OFF(device)
+
+#elif (MAJOR_NR == 2)
 /* floppy */
 #define DEVICE_NAME "floppy"
 #define DEVICE_INTR do_floppy
@@ -61,7 +87,7 @@ extern struct task_struct *wait_for_request;
 #define DEVICE_ON(device)
 #define DEVICE_OFF(device)
 
-#elif
+#else
 /* unknown blk device */
 #error "unknown blk device"
 
@@ -70,7 +96,9 @@ extern struct task_struct *wait_for_request;
 #define CURRENT (blk_dev[MAJOR_NR].current_request)
 #define CURRENT_DEV DEVICE_NR(CURRENT->dev)
 
+#ifdef DEVICE_INTR
 void (*DEVICE_INTR)(void) = NULL;
+#endif
 static void(DEVICE_REQUEST)(void);
 
 extern inline void unlock_buffer(struct buffer_head *bh)
@@ -81,24 +109,54 @@ extern inline void unlock_buffer(struct buffer_head *bh)
     wake_up(&bh->b_wait);
 }
 
+/*
+ * end_request() completes the first buffer of the current request. A
+ * merged request carries several buffers on the b_reqnext chain: as
+ * long as some are left we just move 'buffer' on to the next one and
+ * return, the request itself is finished with the last buffer.
+ */
 extern inline void end_request(int uptodate)
 {
-    DEVICE_OFF(CURRENT->dev);
-    if (CURRENT->bh)
-    {
-        CURRENT->bh->b_uptodate = uptodate;
-        unlock_buffer(CURRENT->bh);
-    }
+    struct buffer_head *bh;
+
     if (!uptodate)
     {
         printk(DEVICE_NAME " I/O error\n\r");
         printk("dev %04x, block %d\n\r", CURRENT->dev,
-               CURRENT->bh->b_blocknr);
+               CURRENT->bh ? CURRENT->bh->b_blocknr : -1);
     }
+    if ((bh = CURRENT->bh) != NULL)
+    {
+        CURRENT->bh = bh->b_reqnext;
+        bh->b_reqnext = NULL;
+        bh->b_uptodate = uptodate;
+        unlock_buffer(bh);
+        if ((bh = CURRENT->bh) != NULL)
+        {
+            CURRENT->errors = 0;
+            CURRENT->current_nr_sectors = 2;
+            CURRENT->buffer = bh->b_data;
+            return;
+        }
+    }
+    DEVICE_OFF(CURRENT->dev);
     wake_up(&CURRENT->waiting);
     wake_up(&wait_for_request);
     CURRENT->dev = -1;
-    CURRENT = CURRENT->next;
+    CURRENT = blk_dev[MAJOR_NR].sched->next_request(CURRENT);
+}
+
+extern inline void init_request_buffers(struct request *req)
+{
+    struct buffer_head *bh;
+
+    for (bh = req->bh; bh; bh = bh->b_reqnext)
+    {
+        if (!bh->b_lock)
+            panic(DEVICE_NAME ": block not locked");
+        bh->b_dirt = 0;
+        bh->b_uptodate = 0;
+    }
 }
 
 #define INIT_REQUEST                                   \
@@ -106,14 +164,7 @@ extern inline void end_request(int uptodate)
         return;                                        \
     if (MAJOR(CURRENT->dev) != MAJOR_NR)               \
         panic(DEVICE_NAME ": request list destroyed"); \
-    if (CURRENT->bh)                                   \
-        if (!CURRENT->bh->b_lock)                      \
-            panic(DEVICE_NAME ": block not locked");   \
-        else                                           \
-        {                                              \
-            CURRENT->bh->b_dirt = 0;                   \
-            CURRENT->bh->b_uptodate = 0;               \
-        }
+    init_request_buffers(CURRENT);
 
 #endif
 
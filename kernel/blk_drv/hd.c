@@ -15,6 +15,7 @@
 #include "../../include/linux/sched.h"
 #include "../../include/linux/fs.h"
 #include "../../include/linux/kernel.h"
+#include "../../include/linux/mm.h"
 #include "../../include/linux/hdreg.h"
 #include "../../include/asm/system.h"
 #include "../../include/asm/io.h"
@@ -33,6 +34,7 @@
 struct hd_i_struct
 {
     int head, sect, cyl, wpcom, lzone, ctl;
+    int lba; /* set by sys_setup() if IDENTIFY says the drive does LBA */
 };
 #ifdef HD_TYPE
 struct hd_i_struct hd_info[] = {HD_TYPE};
@@ -58,10 +60,117 @@ static struct hd_struct
 
 extern void hd_interrupt(void);
 
+/*
+ * PCI IDE bus-master DMA. hd_init() looks for an IDE controller that
+ * can bus-master (the PIIX of most PCs, and of qemu). If there is one,
+ * a request is moved with a single command and a single interrupt, the
+ * buffers being described to the controller by a PRD table. Otherwise
+ * hd_dma stays 0 and we keep using PIO.
+ */
+#define PCI_CONFIG_ADDR 0xCF8
+#define PCI_CONFIG_DATA 0xCFC
+
+struct prd
+{
+    unsigned long addr;  /* physical address of the buffer */
+    unsigned long count; /* bytes in the low 16 bits, bit 31 ends the table */
+};
+
+#define PRD_EOT 0x80000000
+
+static unsigned short hd_dma = 0;
+static struct prd *prd_table = NULL;
+
+static unsigned long pci_config(int dev, int fn, int reg)
+{
+    outl(0x80000000 | (dev << 11) | (fn << 8) | (reg & 0xfc), PCI_CONFIG_ADDR);
+    return inl(PCI_CONFIG_DATA);
+}
+
+static void pci_set_config(int dev, int fn, int reg, unsigned long val)
+{
+    outl(0x80000000 | (dev << 11) | (fn << 8) | (reg & 0xfc), PCI_CONFIG_ADDR);
+    outl(val, PCI_CONFIG_DATA);
+}
+
+static void hd_dma_init(void)
+{
+    int dev, fn;
+
+    for (dev = 0; dev < 32; dev++)
+        for (fn = 0; fn < 8; fn++)
+        {
+            if ((pci_config(dev, fn, 0x00) & 0xffff) == 0xffff)
+                continue;
+            /* class 01 (storage), subclass 01 (IDE), prog-if bit 7 */
+            if ((pci_config(dev, fn, 0x08) >> 8 & 0xffff80) != 0x010180)
+                continue;
+            if (!(prd_table = (struct prd *)get_free_page()))
+                return;
+            pci_set_config(dev, fn, 0x04, pci_config(dev, fn, 0x04) | 0x05);
+            hd_dma = pci_config(dev, fn, 0x20) & 0xfffc;
+            printk("hd: bus-master DMA at %04x\n\r", hd_dma);
+            return;
+        }
+}
+
+/* One PRD entry per buffer: they are BLOCK_SIZE aligned, never crossing 64kB */
+static void hd_setup_dma(void)
+{
+    struct buffer_head *bh;
+    struct prd *prd = prd_table;
+
+    if (!(bh = CURRENT->bh))
+    {
+        prd->addr = (unsigned long)CURRENT->buffer;
+        prd->count = CURRENT->nr_sectors << 9;
+        prd++;
+    }
+    for (; bh; bh = bh->b_reqnext, prd++)
+    {
+        prd->addr = (unsigned long)bh->b_data;
+        prd->count = BLOCK_SIZE;
+    }
+    prd[-1].count |= PRD_EOT;
+    outl((unsigned long)prd_table, hd_dma + BM_PRDT);
+    outb(CURRENT->cmd == READ ? BM_CMD_READ : 0, hd_dma + BM_COMMAND);
+    outb(BM_STAT_ERR | BM_STAT_INTR, hd_dma + BM_STATUS);
+}
+
+static int controller_ready(void);
+
+/*
+ * hd_identify() asks the drive about itself. It is only used from
+ * sys_setup(), before there are any requests, so we just poll with the
+ * drive's interrupt masked (nIEN). Returns 1 with 'id' filled in.
+ */
+static int hd_identify(int drive, unsigned short *id)
+{
+    int i;
+
+    outb(hd_info[drive].ctl | 2, HD_CMD);
+    outb_p(0xA0 | (drive << 4), HD_CURRENT);
+    if (!controller_ready())
+        goto fail;
+    outb(WIN_IDENTIFY, HD_COMMAND);
+    for (i = 0; i < 100000; i++)
+        if ((inb_p(HD_STATUS) & (BUSY_STAT | DRQ_STAT)) == DRQ_STAT)
+            break;
+    if (i == 100000 || (inb(HD_STATUS) & ERR_STAT))
+        goto fail;
+    port_read(HD_DATA, id, 256);
+    outb(hd_info[drive].ctl, HD_CMD);
+    return 1;
+fail:
+    outb(hd_info[drive].ctl, HD_CMD);
+    return 0;
+}
+
 /* This may be used only once, enforced by 'static int callable' */
 int sys_setup(void *BIOS)
 {
     static int callable = 1;
+    static unsigned short id[256];
     int i, drive;
     struct partition *p;
     struct buffer_head *bh;
@@ -90,6 +199,12 @@ int sys_setup(void *BIOS)
         hd[i * 5].start_sect = 0;
         hd[i * 5].nr_sects = hd_info[i].head *
                              hd_info[i].sect * hd_info[i].cyl;
+        /* word 49 bit 9: LBA supported, words 60-61: LBA28 capacity */
+        if (hd_identify(i, id) && (id[49] & 0x200))
+        {
+            hd_info[i].lba = 1;
+            hd[i * 5].nr_sects = id[60] | ((long)id[61] << 16);
+        }
     }
     for (drive = 0; drive < NR_HD; drive++)
     {
@@ -114,6 +229,7 @@ int sys_setup(void *BIOS)
         brelse(bh);
     }
     printk("Partition table%s ok.\n\r", (NR_HD > 1) ? "s" : "");
+    ram_load();
     mount_root();
     return (0);
 }
@@ -144,7 +260,7 @@ static void hd_out(unsigned int drive, unsigned int nsect, unsigned int sect,
 {
     register int port asm("dx");
 
-    if (drive > 1 || head > 15)
+    if (drive > 1 || (head & ~0x40) > 15)
         panic("Trying to write bad sector");
     if (!controller_ready())
         panic("HD controller not ready");
@@ -213,13 +329,25 @@ static void bad_rw_intr(void)
 {
     int i = CURRENT_DEV;
 
+    /* give up on the failing buffer, the rest of the run is retried */
     if (CURRENT->errors++ >= MAX_ERRORS)
+    {
+        CURRENT->sector += CURRENT->current_nr_sectors;
+        CURRENT->nr_sectors -= CURRENT->current_nr_sectors;
         end_request(0);
+    }
     reset_hd(i);
 }
 
+/*
+ * A request may span several buffers (see merge_request()), but it is
+ * issued as a single command: we get one interrupt per sector and
+ * complete each buffer as soon as its last sector has been moved.
+ */
 static void read_intr(void)
 {
+    int i;
+
     if (win_result())
     {
         bad_rw_intr();
@@ -229,27 +357,58 @@ static void read_intr(void)
     CURRENT->errors = 0;
     CURRENT->buffer += 512;
     CURRENT->sector++;
-    if (--CURRENT->nr_sectors)
+    i = --CURRENT->nr_sectors;
+    if (!--CURRENT->current_nr_sectors)
+        end_request(1);
+    if (i)
         return;
-    end_request(1);
     do_hd_request();
 }
 
 static void write_intr(void)
 {
+    int i;
+
     if (win_result())
     {
         bad_rw_intr();
         return;
     }
-    if (--CURRENT->nr_sectors)
+    CURRENT->sector++;
+    CURRENT->buffer += 512;
+    i = --CURRENT->nr_sectors;
+    if (!--CURRENT->current_nr_sectors)
+        end_request(1);
+    if (i)
     {
-        CURRENT->sector++;
-        CURRENT->buffer += 512;
         port_write(HD_DATA, CURRENT->buffer, 256);
         return;
     }
-    end_request(1);
+    do_hd_request();
+}
+
+static void dma_intr(void)
+{
+    struct request *req = CURRENT;
+    int status = inb(hd_dma + BM_STATUS);
+
+    outb(0, hd_dma + BM_COMMAND);
+    outb(status | BM_STAT_ERR | BM_STAT_INTR, hd_dma + BM_STATUS);
+    if (status & BM_STAT_ERR)
+    {
+        printk("hd: DMA failed, using PIO\n\r");
+        hd_dma = 0;
+        win_result();
+        bad_rw_intr();
+        return;
+    }
+    if (win_result())
+    {
+        bad_rw_intr();
+        return;
+    }
+    while (CURRENT == req)
+        end_request(1);
     do_hd_request();
 }
 
@@ -263,20 +422,39 @@ void do_hd_request(void)
     INIT_REQUEST;
     dev = MINOR(CURRENT->dev);
     block = CURRENT->sector;
-    if (dev >= 5 * NR_HD || block + 2 > hd[dev].nr_sects)
+    if (dev >= 5 * NR_HD || block + CURRENT->nr_sectors > hd[dev].nr_sects)
     {
+        CURRENT->sector += CURRENT->current_nr_sectors;
+        CURRENT->nr_sectors -= CURRENT->current_nr_sectors;
         end_request(0);
         goto repeat;
     }
     block += hd[dev].start_sect;
     dev /= 5;
-    __asm__("divl %4" : "=a"(block), "=d"(sec) : "0"(block), "1"(0),
-                                                 "r"(hd_info[dev].sect));
-    __asm__("divl %4" : "=a"(cyl), "=d"(head) : "0"(block), "1"(0),
-                                                "r"(hd_info[dev].head));
-    sec++;
+    if (hd_info[dev].lba)
+    {
+        /* LBA28: 0x40 in the drive/head register selects LBA mode */
+        sec = block & 0xff;
+        cyl = (block >> 8) & 0xffff;
+        head = 0x40 | ((block >> 24) & 0x0f);
+    }
+    else
+    {
+        __asm__("divl %4" : "=a"(block), "=d"(sec) : "0"(block), "1"(0),
+                                                     "r"(hd_info[dev].sect));
+        __asm__("divl %4" : "=a"(cyl), "=d"(head) : "0"(block), "1"(0),
+                                                    "r"(hd_info[dev].head));
+        sec++;
+    }
     nsect = CURRENT->nr_sectors;
-    if (CURRENT->cmd == WRITE)
+    if (hd_dma && (CURRENT->cmd == READ || CURRENT->cmd == WRITE))
+    {
+        hd_setup_dma();
+        hd_out(dev, nsect, sec, head, cyl,
+               CURRENT->cmd == READ ? WIN_READDMA : WIN_WRITEDMA, &dma_intr);
+        outb(inb(hd_dma + BM_COMMAND) | BM_CMD_START, hd_dma + BM_COMMAND);
+    }
+    else if (CURRENT->cmd == WRITE)
     {
         hd_out(dev, nsect, sec, head, cyl, WIN_WRITE, &write_intr);
         for (i = 0; i < 3000 && !(r = inb_p(HD_STATUS) & DRQ_STAT); i++)
@@ -299,6 +477,7 @@ void do_hd_request(void)
 void hd_init(void)
 {
     blk_dev[MAJOR_NR].request_fn = DEVICE_REQUEST;
+    hd_dma_init();
     set_trap_gate(0x2E, &hd_interrupt);
     outb_p(inb_p(0x21) & 0xfb, 0x21);
     outb(inb_p(0xA1) & 0xbf, 0xA1);
@@ -20,23 +20,133 @@
  */
 struct request request[NR_REQUEST];
 
+/*
+ * A merged request never grows past this: the sector count we hand
+ * the controller is only 8 bits wide.
+ */
+#define MAX_MERGE_SECTORS 254
+
 /*
  * used to wait on when there are no free requests
  */
 struct task_struct *wait_for_request = NULL;
 
+/*
+ * The elevator keeps the queue sorted by IN_ORDER, taking the requests
+ * as they come on one sweep and starting a new sweep for the ones that
+ * are behind the head.
+ */
+static void elevator_add(struct request *tmp, struct request *req)
+{
+    for (; tmp->next; tmp = tmp->next)
+        if ((IN_ORDER(tmp, req) ||
+             !IN_ORDER(tmp, tmp->next)) &&
+            IN_ORDER(req, tmp->next))
+            break;
+    req->next = tmp->next;
+    tmp->next = req;
+}
+
+static struct request *elevator_next(struct request *done)
+{
+    return done->next;
+}
+
+/*
+ * The deadline scheduler queues like the elevator, but also keeps the
+ * queued requests of each direction on a fifo ring, oldest first. When
+ * a request is done the fifo heads are checked: one that has waited
+ * longer than its expiry time is served next, reads before writes, and
+ * the sweep carries on from there. The requests it jumped over are
+ * moved to the end of the queue, so they stay in order. A request
+ * leaves its fifo when the driver starts on it.
+ */
+static long deadline_expire[2] = {HZ / 2, 5 * HZ}; /* READ, WRITE */
+
+static void fifo_add(struct request **fifo, struct request *req)
+{
+    if (!*fifo)
+    {
+        *fifo = req->fifo_next = req->fifo_prev = req;
+        return;
+    }
+    req->fifo_next = *fifo;
+    req->fifo_prev = (*fifo)->fifo_prev;
+    (*fifo)->fifo_prev->fifo_next = req;
+    (*fifo)->fifo_prev = req;
+}
+
+static void fifo_remove(struct request **fifo, struct request *req)
+{
+    if (req->fifo_next == req)
+        *fifo = NULL;
+    else
+    {
+        req->fifo_prev->fifo_next = req->fifo_next;
+        req->fifo_next->fifo_prev = req->fifo_prev;
+        if (*fifo == req)
+            *fifo = req->fifo_next;
+    }
+    req->fifo_next = req->fifo_prev = NULL;
+}
+
+static void deadline_add(struct request *tmp, struct request *req)
+{
+    elevator_add(tmp, req);
+    fifo_add(&blk_dev[MAJOR(req->dev)].fifo[req->cmd], req);
+}
+
+static struct request *deadline_next(struct request *done)
+{
+    struct request *req, *prev, *oldest, *head = done->next;
+    struct request **fifo;
+
+    /* 'done' has dev -1 by now, so go by the next request */
+    if (!head)
+        return NULL;
+    fifo = blk_dev[MAJOR(head->dev)].fifo;
+    oldest = head;
+    if (fifo[READ] &&
+        (long)(jiffies - fifo[READ]->start_time) >= deadline_expire[READ])
+        oldest = fifo[READ];
+    else if (fifo[WRITE] &&
+             (long)(jiffies - fifo[WRITE]->start_time) >= deadline_expire[WRITE])
+        oldest = fifo[WRITE];
+    if (oldest != head)
+    {
+        for (prev = head; prev->next != oldest; prev = prev->next)
+            /* nothing */;
+        for (req = oldest; req->next; req = req->next)
+            /* nothing */;
+        req->next = head;
+        prev->next = NULL;
+    }
+    if (oldest->fifo_next)
+        fifo_remove(fifo + oldest->cmd, oldest);
+    return oldest;
+}
+
+static struct io_sched io_sched[] = {
+    {"elevator", elevator_add, elevator_next}, /* IOSCHED_ELEVATOR */
+    {"deadline", deadline_add, deadline_next}  /* IOSCHED_DEADLINE */
+};
+
+#define NR_IO_SCHED ((sizeof(io_sched)) / (sizeof(struct io_sched)))
+
 /* blk_dev_struct is:
  *      do_request-address
  *      next-request
+ *      io scheduler
+ *      deadline fifos
  */
 struct blk_dev_struct blk_dev[NR_BLK_DEV] = {
-    {NULL, NULL}, /* no_dev */
-    {NULL, NULL}, /* dev mem */
-    {NULL, NULL}, /* dev fd */
-    {NULL, NULL}, /* dev hd */
-    {NULL, NULL}, /* dev ttyx */
-    {NULL, NULL}, /* dev tty */
-    {NULL, NULL}  /* dev lp */
+    {NULL, NULL, io_sched, {NULL, NULL}}, /* no_dev */
+    {NULL, NULL, io_sched, {NULL, NULL}}, /* dev mem */
+    {NULL, NULL, io_sched, {NULL, NULL}}, /* dev fd */
+    {NULL, NULL, io_sched, {NULL, NULL}}, /* dev hd */
+    {NULL, NULL, io_sched, {NULL, NULL}}, /* dev ttyx */
+    {NULL, NULL, io_sched, {NULL, NULL}}, /* dev tty */
+    {NULL, NULL, io_sched, {NULL, NULL}}  /* dev lp */
 };
 
 static inline void lock_buffer(struct buffer_head *bh)
@@ -74,16 +184,54 @@ static void add_request(struct blk_dev_struct *dev, struct request *req)
         (dev->request_fn)();
     }
     else
+        dev->sched->add_request(tmp, req);
+    sti();
+}
+
+/*
+ * merge_request() tries to tack 'bh' onto a queued request for the
+ * blocks right before or after it, so that the driver can move the
+ * whole run with one command. The first request on the list is already
+ * being worked on by the driver and is left alone. Only the harddisk
+ * driver knows how to walk the b_reqnext chain. Returns 1 if merged.
+ */
+static int merge_request(int major, int rw, struct buffer_head *bh)
+{
+    struct request *req;
+    unsigned long sector = bh->b_blocknr << 1;
+
+    if (major != 3)
+        return 0;
+    cli();
+    if ((req = blk_dev[major].current_request))
+        req = req->next;
+    for (; req; req = req->next)
     {
-        for (; tmp->next; tmp = tmp->next)
-            if ((IN_ORDER(tmp, req) ||
-                 !IN_ORDER(tmp, tmp->next)) &&
-                IN_ORDER(req, tmp->next))
-                break;
-        req->next = tmp->next;
-        tmp->next = req;
+        if (req->dev != bh->b_dev || req->cmd != rw || !req->bh ||
+            req->nr_sectors + 2 > MAX_MERGE_SECTORS)
+            continue;
+        if (req->sector + req->nr_sectors == sector)
+        {
+            req->bhtail->b_reqnext = bh;
+            req->bhtail = bh;
+            req->nr_sectors += 2;
+            sti();
+            return 1;
+        }
+        if (sector + 2 == req->sector)
+        {
+            bh->b_reqnext = req->bh;
+            req->bh = bh;
+            req->buffer = bh->b_data;
+            req->sector = sector;
+            req->nr_sectors += 2;
+            req->current_nr_sectors = 2;
+            sti();
+            return 1;
+        }
     }
     sti();
+    return 0;
 }
 
 static void make_request(int major, int rw, struct buffer_head *bh)
@@ -107,6 +255,8 @@ static void make_request(int major, int rw, struct buffer_head *bh)
         unlock_buffer(bh);
         return;
     }
+    if (merge_request(major, rw, bh))
+        return;
 repeat:
     for (req = 0 + request; req < NR_REQUEST + request; req++)
         if (req->dev < 0)
@@ -121,9 +271,12 @@ repeat:
     req->errors = 0;
     req->sector = bh->b_blocknr << 1;
     req->nr_sectors = 2;
+    req->current_nr_sectors = 2;
     req->buffer = bh->b_data;
     req->waiting = NULL;
     req->bh = bh;
+    req->bhtail = bh;
+    req->start_time = jiffies;
     req->next = NULL;
     add_request(major + blk_dev, req);
 }
@@ -138,6 +291,41 @@ void ll_rw_block(int rw, struct buffer_head *bh)
     make_request(major, rw, bh);
 }
 
+/*
+ * blk_ioctl() gets or sets the io scheduler of a block major. The
+ * schedulers share the request list, so we can switch at any time:
+ * only the deadline fifos are emptied, the requests on them are still
+ * served in sweep order.
+ */
+int blk_ioctl(int dev, int cmd, int arg)
+{
+    struct blk_dev_struct *bd;
+
+    if (MAJOR(dev) >= NR_BLK_DEV)
+        return -ENODEV;
+    bd = MAJOR(dev) + blk_dev;
+    switch (cmd)
+    {
+    case BLKGETSCHED:
+        return bd->sched - io_sched;
+    case BLKSETSCHED:
+        if (!suser())
+            return -EPERM;
+        if ((unsigned)arg >= NR_IO_SCHED)
+            return -EINVAL;
+        cli();
+        bd->sched = arg + io_sched;
+        while (bd->fifo[READ])
+            fifo_remove(bd->fifo + READ, bd->fifo[READ]);
+        while (bd->fifo[WRITE])
+            fifo_remove(bd->fifo + WRITE, bd->fifo[WRITE]);
+        sti();
+        return 0;
+    default:
+        return -EINVAL;
+    }
+}
+
 /* 初始化块设备请求结构体数组 */
 void blk_dev_init(void)
 {
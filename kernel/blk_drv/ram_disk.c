@@ -4,10 +4,12 @@
  *  Written by Theodore Ts'o
  */
 
+#include "../../include/string.h"
+
 #include "../../include/linux/config.h"
+#include "../../include/linux/sched.h"
 #include "../../include/linux/fs.h"
 #include "../../include/linux/kernel.h"
-#include "../../include/linux/hdreg.h"
 #include "../../include/asm/system.h"
 #include "../../include/asm/segment.h"
 #include "../../include/asm/memory.h"
@@ -15,26 +17,117 @@
 #define MAJOR_NR 1
 #include "blk.h"
 
-char *ram_disk;    /* Start of ram disk */
-int ram_disk_size; /* Size of ram disk */
+char *ram_disk;        /* Start of ram disk */
+int ram_disk_size = 0; /* Size of ram disk */
+
+/* requests are whole sectors, so we can move longwords */
+#define ram_copy(dest, src, len)           \
+    __asm__("cld\n\t"                      \
+            "rep\n\t"                      \
+            "movsl" ::"c"((len) >> 2),     \
+            "S"(src), "D"(dest)            \
+            : "cx", "si", "di")
 
 void do_ram_request(void)
 {
-    int i, r;
-    unsigned int block, dev;
-    unsigned int sec, head, cyl;
-    unsigned int nsect;
+    int len;
+    char *addr;
 
     INIT_REQUEST;
-    if (MINOR(CURRENT->dev) != 0)
+    addr = ram_disk + (CURRENT->sector << 9);
+    len = CURRENT->nr_sectors << 9;
+    if (MINOR(CURRENT->dev) != 0 || addr + len > ram_disk + ram_disk_size)
     {
         end_request(0);
         goto repeat;
     }
-    block = CURRENT->sector;
+    if (CURRENT->cmd == WRITE)
+        ram_copy(addr, CURRENT->buffer, len);
+    else if (CURRENT->cmd == READ)
+        ram_copy(CURRENT->buffer, addr, len);
+    else
+        panic("unknown ramdisk-command");
     end_request(1);
+    goto repeat;
 }
 
-void ram_init(void)
+/*
+ * Returns amount of memory which needs to be reserved.
+ */
+long ram_init(long mem_start, int length)
 {
+    int i;
+    char *cp;
+
+    blk_dev[MAJOR_NR].request_fn = DEVICE_REQUEST;
+    ram_disk = (char *)mem_start;
+    ram_disk_size = length;
+    cp = ram_disk;
+    for (i = 0; i < length; i++)
+        *cp++ = '\0';
+    return (length);
+}
+
+/*
+ * If the root device is the boot floppy, and it has a minix file system
+ * image starting at block 256, copy it into the ram disk and use that as
+ * the root device instead. Called from sys_setup() before mount_root().
+ */
+void ram_load(void)
+{
+    struct buffer_head *bh;
+    struct d_super_block s;
+    int block = 256; /* Start at block 256 */
+    int i = 1;
+    int nblocks;
+    char *cp;
+
+    if (!ram_disk_size)
+        return;
+    printk("Ram disk: %d bytes, starting at 0x%x\n\r", ram_disk_size,
+           (int)ram_disk);
+    if (MAJOR(ROOT_DEV) != 2)
+        return;
+    bh = breada(ROOT_DEV, block + 1, block, block + 2, -1);
+    if (!bh)
+    {
+        printk("Disk error while looking for ramdisk!\n\r");
+        return;
+    }
+    s = *(struct d_super_block *)bh->b_data;
+    brelse(bh);
+    if (s.s_magic != SUPER_MAGIC)
+        /* No ram disk image present, assume normal floppy boot */
+        return;
+    nblocks = s.s_nzones << s.s_log_zone_size;
+    if (nblocks > (ram_disk_size >> BLOCK_SIZE_BITS))
+    {
+        printk("Ram disk image too big!  (%d blocks, %d avail)\n\r",
+               nblocks, ram_disk_size >> BLOCK_SIZE_BITS);
+        return;
+    }
+    printk("Loading %d bytes into ram disk... 0000k",
+           nblocks << BLOCK_SIZE_BITS);
+    cp = ram_disk;
+    while (nblocks)
+    {
+        if (nblocks > 2)
+            bh = breada(ROOT_DEV, block, block + 1, block + 2, -1);
+        else
+            bh = bread(ROOT_DEV, block);
+        if (!bh)
+        {
+            printk("I/O error on block %d, aborting load\n\r", block);
+            return;
+        }
+        ram_copy(cp, bh->b_data, BLOCK_SIZE);
+        brelse(bh);
+        printk("\010\010\010\010\010%4dk", i);
+        cp += BLOCK_SIZE;
+        block++;
+        nblocks--;
+        i++;
+    }
+    printk("\010\010\010\010\010done \n\r");
+    ROOT_DEV = 0x0100;
 }
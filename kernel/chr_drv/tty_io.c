@@ -297,6 +297,8 @@ int tty_write(unsigned channel, char *buf, int nr)
     static cr_flag = 0;
     struct tty_struct *tty;
     char c, *b = buf;
+    char cbuf[64]; /* user data is fetched in chunks, not byte by byte */
+    int cpos = 0, clen = 0;
 
     if (channel > 2 || nr < 0)
         return -1;
@@ -308,7 +310,13 @@ int tty_write(unsigned channel, char *buf, int nr)
             break;
         while (nr > 0 && !FULL(tty->write_q))
         {
-            c = get_fs_byte(b);
+            if (cpos == clen)
+            {
+                clen = (nr < sizeof(cbuf)) ? nr : sizeof(cbuf);
+                copy_from_user(cbuf, b, clen);
+                cpos = 0;
+            }
+            c = cbuf[cpos];
             if (O_POST(tty))
             {
                 if (c == '\r' && O_CRNL(tty))
@@ -325,6 +333,7 @@ int tty_write(unsigned channel, char *buf, int nr)
                     c = toupper(c);
             }
             b++;
+            cpos++;
             nr--;
             cr_flag = 0;
             PUTCH(c, tty->write_q);
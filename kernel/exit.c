@@ -26,6 +26,7 @@ void release(struct task_struct *p)
         if (task[i] == p)
         {
             task[i] = NULL;
+            free_page(p->tss.cr3); /* ignores pg_dir, it's below LOW_MEM */
             free_page((long)p);
             schedule();
             return;
@@ -112,8 +113,17 @@ int do_exit(long code)
 {
     int i;
 
-    free_page_tables(get_base(current->ldt[1]), get_limit(0x0f));
-    free_page_tables(get_base(current->ldt[2]), get_limit(0x17));
+    if (current->vfork)
+    {
+        /* the memory is the parent's: leave it, and release() our pg_dir */
+        current->tss.cr3 = (long)pg_dir;
+        end_vfork();
+    }
+    else
+    {
+        free_page_tables(current->tss.cr3, get_base(current->ldt[1]), get_limit(0x0f));
+        free_page_tables(current->tss.cr3, get_base(current->ldt[2]), get_limit(0x17));
+    }
     for (i = 0; i < NR_TASKS; i++)
         if (task[i] && task[i]->father == current->pid)
             task[i]->father = 0;
@@ -124,6 +134,8 @@ int do_exit(long code)
     current->pwd = NULL;
     iput(current->root);
     current->root = NULL;
+    iput(current->executable);
+    current->executable = NULL;
     if (current->leader && current->tty >= 0)
         tty_table[current->tty].pgrp = 0;
     if (last_task_used_math == current)
@@ -50,12 +50,16 @@ int copy_mem(int nr, struct task_struct *p)
         panic("We don't support separate I&D");
     if (data_limit < code_limit)
         panic("Bad data_limit");
-    new_data_base = new_code_base = nr * 0x4000000;
+    new_data_base = new_code_base = TASK_BASE;
     set_base(p->ldt[1], new_code_base);
     set_base(p->ldt[2], new_data_base);
-    if (copy_page_tables(old_data_base, new_data_base, data_limit))
+    if (!(p->tss.cr3 = get_page_dir()))
+        return -ENOMEM;
+    if (copy_page_tables(current->tss.cr3, p->tss.cr3,
+                         old_data_base, new_data_base, data_limit))
     {
-        free_page_tables(new_data_base, data_limit);
+        free_page_tables(p->tss.cr3, new_data_base, data_limit);
+        free_page(p->tss.cr3);
         return -ENOMEM;
     }
     return 0;
@@ -65,8 +69,12 @@ int copy_mem(int nr, struct task_struct *p)
  *  Ok, this is the main fork-routine. It copies the system process
  * information (task[nr]) and sets up the necessary registers. It
  * also copies the data segment in it's entirety.
+ *
+ * For vfork() the data segment isn't copied at all: the child runs in
+ * the parent's page directory, and the parent sleeps until the child
+ * has exec'ed or exited, see end_vfork().
  */
-int copy_process(int nr, long ebp, long edi, long esi, long gs, long none,
+int copy_process(int vfork, int nr, long ebp, long edi, long esi, long gs, long none,
                  long ebx, long ecx, long edx,
                  long fs, long es, long ds,
                  long eip, long cs, long eflags, long esp, long ss)
@@ -75,7 +83,7 @@ int copy_process(int nr, long ebp, long edi, long esi, long gs, long none,
     int i;
     struct file *f;
 
-    p = (struct task_struct *)get_free_page();
+    p = (struct task_struct *)get_free_page_nozero();
     if (!p)
         return -EAGAIN;
     *p = *current; /* NOTE! this doesn't copy the supervisor stack */
@@ -86,6 +94,8 @@ int copy_process(int nr, long ebp, long edi, long esi, long gs, long none,
     p->signal = 0;
     p->alarm = 0;
     p->leader = 0; /* process leadership doesn't inherit */
+    p->vfork = vfork;
+    p->vfork_wait = NULL;
     p->utime = p->stime = 0;
     p->cutime = p->cstime = 0;
     p->start_time = jiffies;
@@ -112,7 +122,7 @@ int copy_process(int nr, long ebp, long edi, long esi, long gs, long none,
     p->tss.trace_bitmap = 0x80000000;
     if (last_task_used_math == current)
         __asm__("fnsave %0" ::"m"(p->tss.i387));
-    if (copy_mem(nr, p))
+    if (!vfork && copy_mem(nr, p))
     {
         free_page((long)p);
         return -EAGAIN;
@@ -124,10 +134,25 @@ int copy_process(int nr, long ebp, long edi, long esi, long gs, long none,
         current->pwd->i_count++;
     if (current->root)
         current->root->i_count++;
+    if (current->executable)
+        current->executable->i_count++;
     set_tss_desc(gdt + (nr << 1) + FIRST_TSS_ENTRY, &(p->tss));
     set_ldt_desc(gdt + (nr << 1) + FIRST_LDT_ENTRY, &(p->ldt));
     task[nr] = p; /* do this last, just in case */
-    return last_pid;
+    i = p->pid;
+    while (p->vfork)
+        sleep_on(&p->vfork_wait);
+    return i;
+}
+
+/*
+ * end_vfork() is called by a vfork()ed child that stops using its
+ * parent's memory, on exec or exit, and lets the parent run again.
+ */
+void end_vfork(void)
+{
+    current->vfork = 0;
+    wake_up(&current->vfork_wait);
 }
 
 int find_empty_process(void)
@@ -150,8 +150,14 @@ void schedule(void)
     switch_to(next);
 }
 
+/*
+ * Task 0 calls pause() in its idle loop, so that is where idle time
+ * goes to zeroing free pages.
+ */
 int sys_pause(void)
 {
+    if (current == FIRST_TASK)
+        zero_free_pages();
     current->state = TASK_INTERRUPTIBLE;
     schedule();
     return 0;
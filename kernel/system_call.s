@@ -58,13 +58,13 @@ sa_mask = 4
 sa_flags = 8
 sa_restorer = 12
 
-nr_system_calls = 70
+nr_system_calls = 73
 
 /*
 * Ok, I get parallel printer interrupts while using the floppy for some
 * strange reason. Urgel. Now I just ignore them.
 */
-.globl _system_call,_sys_fork,_timer_interrupt,_sys_execve
+.globl _system_call,_sys_fork,_sys_vfork,_timer_interrupt,_sys_execve
 .globl _hd_interrupt,_floppy_interrupt,_parallel_interrupt
 
 .align 2
@@ -168,9 +168,25 @@ pushl %esi
 pushl %edi
 pushl %ebp
 pushl %eax
+pushl $0                # not vfork
 call _copy_process
-addl $20,%esp
-:      ret
+addl $24,%esp
+1:      ret
+
+.align 2
+_sys_vfork:
+call _find_empty_process
+testl %eax,%eax
+js 1f
+push %gs
+pushl %esi
+pushl %edi
+pushl %ebp
+pushl %eax
+pushl $1                # vfork
+call _copy_process
+addl $24,%esp
+1:      ret
 
 _hd_interrupt:
 pushl %eax
@@ -6,6 +6,7 @@
 
 #include "../include/signal.h"
 
+#include "../include/linux/sched.h"
 #include "../include/linux/head.h"
 #include "../include/linux/kernel.h"
 #include "../include/asm/system.h"
@@ -14,13 +15,67 @@ int do_exit(long code);
 
 /* 这段汇编用来刷新页表 */
 #define invalidate() \
-    __asm__("movl %%eax,%%cr3" ::"a"(0))
+    __asm__("movl %%cr3,%%eax\n\tmovl %%eax,%%cr3" ::: "ax")
+
+/*
+ * A 486 or later can flush the TLB entry of a single page with invlpg,
+ * which is a lot cheaper than throwing away the whole TLB. On a 386 we
+ * have to reload cr3. Ranges of more than INVLPG_MAX pages are flushed
+ * whole anyway. Only the current page directory is ever in the TLB.
+ */
+#define INVLPG_MAX 32
+
+static int has_invlpg = 0;
+
+static inline void invalidate_page(unsigned long address)
+{
+    if (has_invlpg)
+        __asm__ __volatile__("invlpg (%0)" ::"r"(address) : "memory");
+    else
+        invalidate();
+}
+
+static void invalidate_range(unsigned long start, unsigned long end)
+{
+    if (!has_invlpg || end - start > INVLPG_MAX * PAGE_SIZE)
+    {
+        invalidate();
+        return;
+    }
+    for (; start < end; start += PAGE_SIZE)
+        __asm__ __volatile__("invlpg (%0)" ::"r"(start) : "memory");
+}
+
+/* the AC flag in eflags can only be changed on a 486 or later */
+static int cpu_is_486(void)
+{
+    unsigned long old, new;
+
+    __asm__("pushfl\n\t"
+            "popl %0\n\t"
+            "movl %0,%1\n\t"
+            "xorl $0x40000,%0\n\t"
+            "pushl %0\n\t"
+            "popfl\n\t"
+            "pushfl\n\t"
+            "popl %0\n\t"
+            "pushl %1\n\t"
+            "popfl"
+            : "=&r"(new), "=&r"(old));
+    return ((old ^ new) & 0x40000) != 0;
+}
+
+/*
+ * Every task has a page directory of its own (tss.cr3). Directories are
+ * identity-mapped like the rest of physical memory, so this gives the
+ * entry for a linear address in the directory at physical 'pgd'.
+ */
+#define dir_entry(pgd, address) \
+    ((unsigned long *)((pgd) + (((address) >> 20) & 0xffc)))
 
 /* these are not to be changed without changing head.s etc */
 #define LOW_MEM 0x100000                         //系统的低端物理内存的地址，用于在内核中确定内存的起始位置，内存分页是从这里开始的。
                                                  // 低于LOW_MEM的物理内存用于内核代码和数据结构的存储
-#define PAGING_MEMORY (15 * 1024 * 1024)         // 表示系统中用于分页的内存大小，这里为 15 MB
-#define PAGING_PAGES (PAGING_MEMORY >> 12)       // 系统中分页的总页数
 #define MAP_NR(addr) (((addr) - LOW_MEM) >> 12)  // 将给定地址映射为对应的页号
 #define USED 100                                 // 页面被使用的标识
 
@@ -30,33 +85,115 @@ static long HIGH_MEMORY = 0;
 #define copy_page(from, to) \
     __asm__("cld ; rep ; movsl" ::"S"(from), "D"(to), "c"(1024) : "cx", "di", "si")
 
-static unsigned char mem_map[PAGING_PAGES] = {0,};  // 标记某一个页是否被使用
+/*
+ * mem_map has one count per page above LOW_MEM. It is sized for the
+ * memory we actually have, and mem_init() puts it at the start of main
+ * memory.
+ */
+static unsigned char *mem_map = NULL;  // 标记某一个页是否被使用
+static long paging_pages = 0;          // 系统中分页的总页数
+
+/*
+ * Free pages are kept on two lists threaded through their first long
+ * word, so getting and freeing a page doesn't have to scan mem_map.
+ * Pages on zero_page_list are known to be zero apart from the link
+ * word; the idle task moves pages over to it in zero_free_pages().
+ * All of this is called from interrupt level (malloc), hence the cli.
+ */
+static unsigned long free_page_list = 0;
+static unsigned long zero_page_list = 0;
+static long nr_free_pages = 0;
+
+/*
+ * Read faults on anonymous memory (bss, brk, stack) map this page
+ * read-only; the first write gets a real page through un_wp_page().
+ * It is mapped any number of times, so its mem_map count is left alone.
+ */
+static unsigned long empty_zero_page = 0;
+
+#define zero_page(addr) \
+    __asm__("cld ; rep ; stosl" ::"a"(0), "D"(addr), "c"(1024) : "cx", "di")
+
+/* pop a page off a list, with interrupts off. Returns 0 if it's empty */
+static inline unsigned long pop_page(unsigned long *list)
+{
+    unsigned long page;
+
+    if ((page = *list))
+    {
+        *list = *(unsigned long *)page;
+        *(unsigned long *)page = 0;
+        nr_free_pages--;
+        mem_map[MAP_NR(page)] = 1;
+    }
+    return page;
+}
 
 /*
- * Get physical address of first (actually last :-) free page, and mark it
- * used. If no free pages left, return 0.
+ * Get physical address of a free, zeroed page, and mark it used.
+ * If no free pages left, return 0.
  * 在系统中查找一个空闲的页面，将其标记为使用，并返回该页面的物理地址
  */
 unsigned long get_free_page(void)
 {
-    register unsigned long __res asm("ax");
-
-    __asm__("std ; repne ; scasb\n\t"
-            "jne 1f\n\t"
-            "movb $1,1(%%edi)\n\t"
-            "sall $12,%%ecx\n\t"
-            "addl %2,%%ecx\n\t"
-            "movl %%ecx,%%edx\n\t"
-            "movl $1024,%%ecx\n\t"
-            "leal 4092(%%edx),%%edi\n\t"
-            "rep ; stosl\n\t"
-            "movl %%edx,%%eax\n"
-            "1:"
-            : "=a"(__res)
-            : "0"(0), "i"(LOW_MEM), "c"(PAGING_PAGES),
-              "D"(mem_map + PAGING_PAGES - 1)
-            : "di", "cx", "dx");
-    return __res;
+    unsigned long page, flags;
+    int zeroed;
+
+    save_flags(flags);
+    cli();
+    if (!(zeroed = (page = pop_page(&zero_page_list)) != 0))
+        page = pop_page(&free_page_list);
+    restore_flags(flags);
+    if (page && !zeroed)
+        zero_page(page);
+    return page;
+}
+
+/*
+ * get_free_page_nozero() is for callers that overwrite the whole page
+ * anyway (copy-on-write, ...). It leaves the zeroed pages for others.
+ */
+unsigned long get_free_page_nozero(void)
+{
+    unsigned long page, flags;
+
+    save_flags(flags);
+    cli();
+    if (!(page = pop_page(&free_page_list)))
+        page = pop_page(&zero_page_list);
+    restore_flags(flags);
+    return page;
+}
+
+/*
+ * zero_free_pages() is called by the idle task. It zeroes a few pages
+ * from the free list with interrupts on and moves them to the zeroed
+ * list, so that page faults find them ready. The batch is small, as we
+ * don't get preempted and someone might have become runnable meanwhile.
+ */
+#define ZERO_BATCH 8
+
+void zero_free_pages(void)
+{
+    unsigned long page, flags;
+    int i;
+
+    for (i = 0; i < ZERO_BATCH; i++)
+    {
+        save_flags(flags);
+        cli();
+        if ((page = free_page_list))
+            free_page_list = *(unsigned long *)page;
+        restore_flags(flags);
+        if (!page)
+            return;
+        zero_page(page);
+        save_flags(flags);
+        cli();
+        *(unsigned long *)page = zero_page_list;
+        zero_page_list = page;
+        restore_flags(flags);
+    }
 }
 
 /*
@@ -66,24 +203,38 @@ unsigned long get_free_page(void)
  */
 void free_page(unsigned long addr)
 {
+    unsigned long flags;
+
     if (addr < LOW_MEM)
         return;
-    if (addr > HIGH_MEMORY)
+    if (addr >= HIGH_MEMORY)
         panic("trying to free nonexistent page");
-    addr -= LOW_MEM;
-    addr >>= 12;
-    if (mem_map[addr]--)
+    addr &= 0xfffff000;
+    if (addr == empty_zero_page)
         return;
-    mem_map[addr] = 0;
-    panic("trying to free free page");
+    save_flags(flags);
+    cli();
+    if (!mem_map[MAP_NR(addr)])
+    {
+        restore_flags(flags);
+        panic("trying to free free page");
+    }
+    if (!--mem_map[MAP_NR(addr)])
+    {
+        *(unsigned long *)addr = free_page_list;
+        free_page_list = addr;
+        nr_free_pages++;
+    }
+    restore_flags(flags);
 }
 
 /*
  * This function frees a continuos block of page tables, as needed
- * by 'exit()'. As does copy_page_tables(), this handles only 4Mb blocks.
+ * by 'exit()', in the page directory 'pgd'. As does copy_page_tables(),
+ * this handles only 4Mb blocks.
  * 释放从指定位置 from 开始的一定大小的页表
  */
-int free_page_tables(unsigned long from, unsigned long size)
+int free_page_tables(unsigned long pgd, unsigned long from, long size)
 {
     unsigned long *pg_table;
     unsigned long *dir, nr;
@@ -93,12 +244,19 @@ int free_page_tables(unsigned long from, unsigned long size)
     if (!from) // 检查起始地址是否为0，如果是，表示尝试释放交换空间，这是不允许的。
         panic("Trying to free up swapper memory space");
     size = (size + 0x3fffff) >> 22; // 这行代码应该是为了确保对齐和截断操作。我理解一个页表项下面有1024个页，每个页是4KB
-    dir = (unsigned long *)((from >> 20) & 0xffc); /* _pg_dir = 0 取最高位的10位，我理解这里是找到页表的起始位置 */  
+    dir = dir_entry(pgd, from); /* 取最高位的10位，我理解这里是找到页表的起始位置 */
     for (; size-- > 0; dir++) // dir[0]、dir[1]、dir[2]... 为不同的页表
     {
         if (!(1 & *dir)) //表示该页表未使用
             continue;
         pg_table = (unsigned long *)(0xfffff000 & *dir); /* 取高20位, 高20位存储页表项的物理地址，低12位存储页表项偏移量 */
+        if (mem_map[MAP_NR((unsigned long)pg_table)] > 1)
+        {
+            /* still shared after fork: just drop our reference */
+            free_page((unsigned long)pg_table);
+            *dir = 0;
+            continue;
+        }
         for (nr = 0; nr < 1024; nr++)                    /* 每个页表有1024个页表项 */
         {
             if (1 & *pg_table)
@@ -109,7 +267,9 @@ int free_page_tables(unsigned long from, unsigned long size)
         free_page(0xfffff000 & *dir);  // dir 看起来像是二维数组
         *dir = 0;
     }
-    invalidate();
+    /* a whole address space goes: cheaper to flush it all, if it's ours */
+    if (pgd == current->tss.cr3)
+        invalidate();
     return 0;
 }
 
@@ -129,8 +289,15 @@ int free_page_tables(unsigned long from, unsigned long size)
  * doesn't take any more memory - we don't copy-on-write in the low
  * 1 Mb-range, so the pages can be shared with the kernel. Thus the
  * special case for nr=xxxx.
+ *
+ * NOTE 3! Otherwise the page tables themselves aren't copied at all:
+ * both directories point to the same table, write-protected in the
+ * directory entry and counted in mem_map. The first one to change an
+ * entry in it gets a copy of its own, see unshare_table(). A fork that
+ * is followed by exec thus never copies a page table.
  */
-int copy_page_tables(unsigned long from, unsigned long to, long size)
+int copy_page_tables(unsigned long from_pgd, unsigned long to_pgd,
+                     unsigned long from, unsigned long to, long size)
 {
     unsigned long *from_page_table;
     unsigned long *to_page_table;
@@ -140,8 +307,8 @@ int copy_page_tables(unsigned long from, unsigned long to, long size)
 
     if ((from & 0x3fffff) || (to & 0x3fffff))   // from 和 to 都必须是4MB的整数倍
         panic("copy_page_tables called with wrong alignment");
-    from_dir = (unsigned long *)((from >> 20) & 0xffc); /* _pg_dir = 0 */
-    to_dir = (unsigned long *)((to >> 20) & 0xffc);
+    from_dir = dir_entry(from_pgd, from);
+    to_dir = dir_entry(to_pgd, to);
     size = ((unsigned)(size + 0x3fffff)) >> 22;
     for (; size-- > 0; from_dir++, to_dir++)
     {
@@ -150,6 +317,13 @@ int copy_page_tables(unsigned long from, unsigned long to, long size)
         if (!(1 & *from_dir))
             continue;
         from_page_table = (unsigned long *)(0xfffff000 & *from_dir);
+        if (from)
+        {
+            *from_dir &= ~2;
+            *to_dir = *from_dir;
+            mem_map[MAP_NR((unsigned long)from_page_table)]++;
+            continue;
+        }
         if (!(to_page_table = (unsigned long *)get_free_page()))
             return -1; /* Out of memory, see freeing */
         *to_dir = ((unsigned long)to_page_table) | 7;
@@ -161,7 +335,8 @@ int copy_page_tables(unsigned long from, unsigned long to, long size)
                 continue;
             this_page &= ~2;
             *to_page_table = this_page;
-            if (this_page > LOW_MEM)
+            if (this_page > LOW_MEM &&
+                (this_page & 0xfffff000) != empty_zero_page)
             {
                 *from_page_table = this_page;
                 this_page -= LOW_MEM;
@@ -174,25 +349,83 @@ int copy_page_tables(unsigned long from, unsigned long to, long size)
     return 0;
 }
 
+/*
+ * unshare_table() returns the page table behind a (present) directory
+ * entry of the current task, ready to have entries changed. A table that
+ * fork left shared (the entry is write-protected) is copied first: the
+ * pages in it are then referenced by two tables, so they are counted
+ * again and write-protected in both, as copy_page_tables() used to do.
+ * If we turn out to be the last user, the table is simply taken over.
+ * 'address' is any linear address the entry maps. Returns 0 if out of
+ * memory.
+ */
+static unsigned long *unshare_table(unsigned long *dir, unsigned long address)
+{
+    unsigned long old_table, new_table, this_page;
+    unsigned long *from, *to;
+    int nr, first = 1024, last = -1;
+
+    old_table = 0xfffff000 & *dir;
+    if (*dir & 2)
+        return (unsigned long *)old_table;
+    if (mem_map[MAP_NR(old_table)] == 1)
+    {
+        /*
+         * Allowing more needs no flush: a stale read-only entry just
+         * faults once more, and the fault drops it from the TLB.
+         */
+        *dir |= 2;
+        return (unsigned long *)old_table;
+    }
+    if (!(new_table = get_free_page_nozero()))
+        return 0;
+    from = (unsigned long *)old_table;
+    to = (unsigned long *)new_table;
+    for (nr = 0; nr < 1024; nr++, from++, to++)
+    {
+        this_page = *from;
+        if (1 & this_page)
+        {
+            if (this_page & 2)
+            {
+                if (nr < first)
+                    first = nr;
+                last = nr;
+            }
+            this_page &= ~2;
+            *from = this_page;
+            if (this_page > LOW_MEM &&
+                (this_page & 0xfffff000) != empty_zero_page)
+                mem_map[MAP_NR(this_page)]++;
+        }
+        *to = this_page;
+    }
+    mem_map[MAP_NR(old_table)]--;
+    *dir = new_table | 7;
+    /* only the pages we just write-protected can be wrong in the TLB */
+    address &= 0xffc00000;
+    if (last >= 0)
+        invalidate_range(address + (first << 12), address + ((last + 1) << 12));
+    return (unsigned long *)new_table;
+}
+
 /*
  * This function puts a page in memory at the wanted address.
  * It returns the physical address of the page gotten, 0 if
  * out of memory (either when trying to access page-table or
  * page.)
  */
-unsigned long put_page(unsigned long page, unsigned long address)
+static unsigned long map_page(unsigned long page, unsigned long address,
+                              int prot)
 {
     unsigned long tmp, *page_table;
 
-    /* NOTE !!! This uses the fact that _pg_dir=0 */
-
-    if (page < LOW_MEM || page > HIGH_MEMORY)
-        printk("Trying to put page %p at %p\n", page, address);
-    if (mem_map[(page - LOW_MEM) >> 12] != 1)
-        printk("mem_map disagrees with %p at %p\n", page, address);
-    page_table = (unsigned long *)((address >> 20) & 0xffc);
+    page_table = dir_entry(current->tss.cr3, address);
     if ((*page_table) & 1)
-        page_table = (unsigned long *)(0xfffff000 & *page_table);
+    {
+        if (!(page_table = unshare_table(page_table, address)))
+            return 0;
+    }
     else
     {
         if (!(tmp = get_free_page()))
@@ -200,91 +433,314 @@ unsigned long put_page(unsigned long page, unsigned long address)
         *page_table = tmp | 7;
         page_table = (unsigned long *)tmp;
     }
-    page_table[(address >> 12) & 0x3ff] = page | 7;
+    page_table[(address >> 12) & 0x3ff] = page | prot;
     return page;
 }
 
-void un_wp_page(unsigned long *table_entry)
+unsigned long put_page(unsigned long page, unsigned long address)
+{
+    if (page < LOW_MEM || page > HIGH_MEMORY)
+        printk("Trying to put page %p at %p\n", page, address);
+    if (mem_map[(page - LOW_MEM) >> 12] != 1)
+        printk("mem_map disagrees with %p at %p\n", page, address);
+    return map_page(page, address, 7);
+}
+
+void un_wp_page(unsigned long *table_entry, unsigned long address)
 {
     unsigned long old_page, new_page;
 
     old_page = 0xfffff000 & *table_entry;
+    if (old_page == empty_zero_page)
+    {
+        if (!(new_page = get_free_page()))
+            do_exit(SIGSEGV);
+        *table_entry = new_page | 7;
+        invalidate_page(address);
+        return;
+    }
     if (old_page >= LOW_MEM && mem_map[MAP_NR(old_page)] == 1)
     {
         *table_entry |= 2;
+        invalidate_page(address);
         return;
     }
-    if (!(new_page = get_free_page()))
+    if (!(new_page = get_free_page_nozero()))
         do_exit(SIGSEGV);
     if (old_page >= LOW_MEM)
         mem_map[MAP_NR(old_page)]--;
-    *table_entry = new_page | 7;
     copy_page(old_page, new_page);
+    *table_entry = new_page | 7;
+    invalidate_page(address);
 }
 
 /*
  * This routine handles present pages, when users try to write
  * to a shared page. It is done by copying the page to a new address
- * and decrementing the shared-page counter for the old page.
+ * and decrementing the shared-page counter for the old page. The
+ * page table may be shared too, then it is copied first.
  */
 void do_wp_page(unsigned long error_code, unsigned long address)
 {
-    un_wp_page((unsigned long *)(((address >> 10) & 0xffc) + (0xfffff000 &
-                                                              *((unsigned long *)((address >> 20) & 0xffc)))));
+    unsigned long *table;
+
+    if (!(table = unshare_table(dir_entry(current->tss.cr3, address), address)))
+        do_exit(SIGSEGV);
+    table += (address >> 12) & 0x3ff;
+    if (!(*table & 2))
+        un_wp_page(table, address);
 }
 
 void write_verify(unsigned long address)
 {
     unsigned long page;
 
-    if (!((page = *((unsigned long *)((address >> 20) & 0xffc))) & 1))
+    if (!((page = *dir_entry(current->tss.cr3, address)) & 1))
         return;
-    page &= 0xfffff000;
+    if (!(page = (unsigned long)unshare_table(dir_entry(current->tss.cr3, address), address)))
+        do_exit(SIGSEGV);
     page += ((address >> 10) & 0xffc);
     if ((3 & *(unsigned long *)page) == 1) /* non-writeable, present */
-        un_wp_page((unsigned long *)page);
+        un_wp_page((unsigned long *)page, address);
     return;
 }
 
+void get_empty_page(unsigned long address)
+{
+    unsigned long tmp;
+
+    if (!(tmp = get_free_page()) || !put_page(tmp, address))
+    {
+        free_page(tmp); /* 0 is ok - ignored */
+        do_exit(SIGSEGV);
+    }
+}
+
+/*
+ * try_to_share() checks the page at address "address" in the task "p",
+ * to see if it exists, and if it is clean. If so, share it with the current
+ * task.
+ *
+ * NOTE! This assumes we have checked that p != current, and that they
+ * share the same executable.
+ */
+static int try_to_share(unsigned long address, struct task_struct *p)
+{
+    unsigned long from;
+    unsigned long to;
+    unsigned long from_page;
+    unsigned long to_page;
+    unsigned long phys_addr;
+
+    from_page = to_page = ((address >> 20) & 0xffc);
+    from_page += p->tss.cr3 + ((get_base(p->ldt[1]) >> 20) & 0xffc);
+    to_page += current->tss.cr3 + ((get_base(current->ldt[1]) >> 20) & 0xffc);
+    /* is there a page-directory at from? */
+    from = *(unsigned long *)from_page;
+    if (!(from & 1))
+        return 0;
+    from &= 0xfffff000;
+    from_page = from + ((address >> 10) & 0xffc);
+    phys_addr = *(unsigned long *)from_page;
+    /* is the page clean and present? */
+    if ((phys_addr & 0x41) != 0x01)
+        return 0;
+    phys_addr &= 0xfffff000;
+    if (phys_addr >= HIGH_MEMORY || phys_addr < LOW_MEM)
+        return 0;
+    to = *(unsigned long *)to_page;
+    if (!(to & 1))
+    {
+        if ((to = get_free_page()))
+            *(unsigned long *)to_page = to | 7;
+        else
+            do_exit(SIGSEGV);
+    }
+    else if (!(to = (unsigned long)unshare_table((unsigned long *)to_page,
+                                                  get_base(current->ldt[1]) + address)))
+        do_exit(SIGSEGV);
+    to &= 0xfffff000;
+    to_page = to + ((address >> 10) & 0xffc);
+    if (1 & *(unsigned long *)to_page)
+        panic("try_to_share: to_page already exists");
+    /*
+     * share them: write-protect. No TLB flush: p isn't running, and
+     * our entry wasn't present before.
+     */
+    *(unsigned long *)from_page &= ~2;
+    *(unsigned long *)to_page = *(unsigned long *)from_page;
+    mem_map[MAP_NR(phys_addr)]++;
+    return 1;
+}
+
+/*
+ * share_page() tries to find a process that could share a page with
+ * the current one. Address is the address of the wanted page relative
+ * to the start of the code segment.
+ */
+static int share_page(unsigned long address)
+{
+    struct task_struct **p;
+
+    if (!current->executable)
+        return 0;
+    if (current->executable->i_count < 2)
+        return 0;
+    for (p = &LAST_TASK; p > &FIRST_TASK; --p)
+    {
+        if (!*p)
+            continue;
+        if (current == *p)
+            continue;
+        if ((*p)->executable != current->executable)
+            continue;
+        if (try_to_share(address, *p))
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * do_no_page() fills in a page that isn't present. Anything below
+ * end_data comes from the executable: it is shared with another task
+ * running the same binary if one has it, else read in from the file.
+ * Everything else (bss, brk, stack) gets an empty page on a write fault
+ * and the shared zero page on a read fault.
+ */
 void do_no_page(unsigned long error_code, unsigned long address)
 {
+    int nr[4];
     unsigned long tmp;
+    unsigned long page;
+    int block, i;
 
-    if (tmp = get_free_page())
-        if (put_page(tmp, address))
-            return;
+    address &= 0xfffff000;
+    tmp = address - get_base(current->ldt[1]);
+    if (!current->executable || tmp >= current->end_data)
+    {
+        if (error_code & 2)
+            get_empty_page(address);
+        else if (!map_page(empty_zero_page, address, 5))
+            do_exit(SIGSEGV);
+        return;
+    }
+    if (share_page(tmp))
+        return;
+    if (!(page = get_free_page()))
+        do_exit(SIGSEGV);
+    /* remember that 1 block is used for header */
+    block = 1 + tmp / BLOCK_SIZE;
+    for (i = 0; i < 4; block++, i++)
+        nr[i] = bmap(current->executable, block);
+    bread_page(page, current->executable->i_dev, nr);
+    i = tmp + 4096 - current->end_data;
+    tmp = page + 4096;
+    while (i-- > 0)
+    {
+        tmp--;
+        *(char *)tmp = 0;
+    }
+    if (put_page(page, address))
+        return;
+    free_page(page);
     do_exit(SIGSEGV);
 }
 
+/*
+ * get_page_dir() returns a new page directory for fork. The kernel's
+ * part of pg_dir, the identity map below TASK_BASE, is the same in all
+ * of them: the page tables are shared, only the entries are copied.
+ */
+unsigned long get_page_dir(void)
+{
+    unsigned long pgd;
+    int i;
+
+    if (!(pgd = get_free_page()))
+        return 0;
+    for (i = 0; i < (TASK_BASE >> 22); i++)
+        ((unsigned long *)pgd)[i] = pg_dir[i];
+    return pgd;
+}
+
+/*
+ * head.s only identity-maps the first 16MB. paging_init() maps the rest
+ * of physical memory, up to end_mem, with page tables taken from
+ * start_mem, and returns the amount of memory used for them. If head.s
+ * found 4MB pages (PSE), whole 4MB chunks are mapped with those and
+ * need no table; only a partial chunk at the end gets one.
+ */
+long paging_init(long start_mem, long end_mem)
+{
+    unsigned long *pg_table, *dir;
+    unsigned long addr = 16 * 1024 * 1024;
+    long used = 0;
+    int i, pse = pg_dir[1] & 0x80;
+
+    for (dir = pg_dir + (addr >> 22); addr < end_mem; dir++)
+    {
+        if (pse && addr + 0x400000 <= end_mem)
+        {
+            *dir = addr | 0x87;
+            addr += 0x400000;
+            continue;
+        }
+        pg_table = (unsigned long *)(start_mem + used);
+        used += PAGE_SIZE;
+        for (i = 0; i < 1024; i++, addr += PAGE_SIZE)
+            pg_table[i] = (addr < end_mem) ? (addr | 7) : 0;
+        *dir = ((unsigned long)pg_table) | 7;
+    }
+    invalidate();
+    return used;
+}
+
 /* 系统初始化阶段初始化内存管理子系统 start_mem、end_mem以字节为单位 */
 void mem_init(long start_mem, long end_mem)
 {
     int i;
 
     HIGH_MEMORY = end_mem;   // 将系统可用的最高内存设置为end_mem
-    for (i = 0; i < PAGING_PAGES; i++)
+    has_invlpg = cpu_is_486();
+    paging_pages = (end_mem - LOW_MEM) >> 12;
+    mem_map = (unsigned char *)start_mem;
+    start_mem += (paging_pages + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    for (i = 0; i < paging_pages; i++)
         mem_map[i] = USED;   // mem_map 用于跟踪系统中每一页内存的状态，初始化的时候将其标记为已使用, mem_map被static修饰,存储在数据段 .data
     i = MAP_NR(start_mem);   // 计算start_mem对应的页号，这里是物理内存的页号, 物理内存低于0x100000的地址用于其他用途
     end_mem -= start_mem;    // 这两行代码计算内存范围的页数，并存储在end_mem中
     end_mem >>= 12;          // 这里12是因为在x86架构下，一个页面大小是4KB，即2^12字节     内存和硬盘存储容量以字节(Byte)为单位,网络传输中,以bit衡量速度.
     while (end_mem-- > 0)    // 重新遍历所有的内存页，标记为未使用
         mem_map[i++] = 0;
+    /* build the free list so that the highest pages are handed out first */
+    for (i = MAP_NR(start_mem); i < paging_pages && !mem_map[i]; i++)
+    {
+        *(unsigned long *)(LOW_MEM + (i << 12)) = free_page_list;
+        free_page_list = LOW_MEM + (i << 12);
+        nr_free_pages++;
+    }
+    if (!(empty_zero_page = get_free_page()))
+        panic("mem_init: no memory for the zero page");
 }
 
 void calc_mem(void)
 {
     int i, j, k, free = 0;
     long *pg_tbl;
+    unsigned long *dir = (unsigned long *)current->tss.cr3;
 
-    for (i = 0; i < PAGING_PAGES; i++)
+    for (i = 0; i < paging_pages; i++)
         if (!mem_map[i])
             free++;
-    printk("%d pages free (of %d)\n\r", free, PAGING_PAGES);
-    for (i = 2; i < 1024; i++)
+    if (free != nr_free_pages)
+        printk("free page count wrong: %d (list says %d)\n\r",
+               free, nr_free_pages);
+    printk("%d pages free (of %d)\n\r", free, paging_pages);
+    for (i = TASK_BASE >> 22; i < 1024; i++)
     {
-        if (1 & pg_dir[i])
+        if (1 & dir[i])
         {
-            pg_tbl = (long *)(0xfffff000 & pg_dir[i]);
+            pg_tbl = (long *)(0xfffff000 & dir[i]);
             for (j = k = 0; j < 1024; j++)
                 if (pg_tbl[j] & 1)
                     k++;